@@ -7,32 +7,32 @@
 #include "ethernet_interface.h"
 #include "serial.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
 
 extern _WIZCHIP  WIZCHIP;
 
 static EthernetInterface_t ethernet_h = {0};
 static SocketHandle_t sockets[_WIZCHIP_SOCK_NUM_] = {0};
+// Pending open/close per socket. Separate, so an open of a socket whose close is still queued
+// isn't lost, the bulk lane runs them in order (close, then open)
+static SPI_Completion_t socket_open_requests[_WIZCHIP_SOCK_NUM_] = {0};
+static SPI_Completion_t socket_close_requests[_WIZCHIP_SOCK_NUM_] = {0};
 
 // Static allocation for RX- and TX Buffers
 // Allows for Buffer resizing without dynamic memory allocation
-static uint8_t rx_buffer_pool[WIZ_MAX_BUFFER_SIZE];
-static uint8_t tx_buffer_pool[WIZ_MAX_BUFFER_SIZE];
+// Aligned to a cache line, the kByte partitions are received into by DMA without a bounce
+static uint8_t rx_buffer_pool[WIZ_MAX_BUFFER_SIZE] __ALIGNED(SPI_DCACHE_LINE);
+static uint8_t tx_buffer_pool[WIZ_MAX_BUFFER_SIZE] __ALIGNED(SPI_DCACHE_LINE);
 
 void Ethernet_Init() {
 	// Check if WIZCHIP has been initialized
 	if(!WIZCHIP.gen_device_h) return;
 
-	// Select right RTOS-Queue functions depending on device handle
+	// Select the executor of the bus the W5500 is connected to
 	bus_device_t* device_h = (bus_device_t*) WIZCHIP.gen_device_h;
-	if (device_h->spi_device_handle.spi_h->Instance == SPI1) {
-		ethernet_h.spiQueueRequest = SPI_QueueRequest;
-		ethernet_h.spiQueueRequest_fromISR = SPI_QueueRequest_fromISR;
-	}
-	else if (device_h->spi_device_handle.spi_h->Instance == SPI2) {
-		ethernet_h.spiQueueRequest = SPI2_QueueRequest;
-		ethernet_h.spiQueueRequest_fromISR = SPI2_QueueRequest_fromISR;
-	}
-	else {
+	ethernet_h.spiExecutor = SPI_Task_GetExecutor(device_h->spi_device_handle.spi_h->Instance);
+	if (ethernet_h.spiExecutor == NULL) {
 		// TODO Error Handling
 		return;
 	}
@@ -68,7 +68,16 @@ void Ethernet_Init() {
 }
 
 void Ethernet_IRQ_Callback(uint8_t ID, GPIO_DI_TypeDef DI, PinTriggerEdge_TypeDef edge){
-	ethernet_h.spiQueueRequest_fromISR(__IRQ_Callback_CB, (void*) 0);
+	// One pending service reads all interrupt flags, further edges are coalesced
+	SPI_Queue_Data_t irq_request = {
+		.SPI_Request_Fp = __IRQ_Callback_CB,
+		.Handle = (void*) 0,
+		.Flags = SPI_REQUEST_FLAG_IDEMPOTENT
+	};
+
+	// Interrupt servicing must not wait behind queued socket operations.
+	// If the ISR ring is full, services are pending already and will see this interrupt.
+	SPI_Executor_Send_Request_fromISR(ethernet_h.spiExecutor, irq_request, SPI_PRIO_URGENT);
 }
 
 void __IRQ_Callback_CB(void* pData) {
@@ -119,6 +128,12 @@ void __IRQ_Callback_CB(void* pData) {
 				debugEthPrintWithInfo(sockets[sockNum].port, sockNum, sockets[sockNum].RX_BUFFER.buffer, recvLen);
 			}
 
+			// Debug commands
+			if(sockets[sockNum].port == DEBUG_PORT && recvLen >= (int32_t) (sizeof(ETHERNET_CMD_SPI_STATS) - 1) &&
+			   memcmp(sockets[sockNum].RX_BUFFER.buffer, ETHERNET_CMD_SPI_STATS, sizeof(ETHERNET_CMD_SPI_STATS) - 1) == 0) {
+				Ethernet_dumpSpiStats();
+			}
+
 			// Call registered callback Function
 			socket_cb(sockets[sockNum], SE_RX, (void*) NULL);
 		}
@@ -144,6 +159,10 @@ void __IRQ_Callback_CB(void* pData) {
 
 void Ethernet_initPort(uint16_t port, EthernetProtocol_t protocol, SocketCallbackFunction callback) {
 	uint8_t sockNum = __Ethernet_getFreeSocket();
+	if(sockNum >= _WIZCHIP_SOCK_NUM_) {
+		debugEthPrintWithInfoStr(port, sockNum, (uint8_t*) "No free socket");
+		return;
+	}
 	sockets[sockNum].SocketCallbackFP = (void*) callback;
 
 	Ethernet_openSocket(sockNum, protocol, port, 0);
@@ -151,6 +170,14 @@ void Ethernet_initPort(uint16_t port, EthernetProtocol_t protocol, SocketCallbac
 
 // Check if invalid sockNum
 void Ethernet_openSocket(uint8_t sockNum, uint8_t protocol, uint16_t port, uint8_t flag) {
+	SPI_Completion_t* completion = &socket_open_requests[sockNum];
+	EthernetSocketArgs_t args = {
+		.sockNum = sockNum,
+		.protocol = protocol,
+		.flag = flag,
+		.port = port
+	};
+
 	// Save socket parameters
 	sockets[sockNum].protocol = protocol;
 	sockets[sockNum].port = port;
@@ -160,34 +187,57 @@ void Ethernet_openSocket(uint8_t sockNum, uint8_t protocol, uint16_t port, uint8
 	// Mark as in use
 	sockets[sockNum].inUse = true;
 
-	// Queue Request in SPI-Task
-	ethernet_h.spiQueueRequest(__openSocket_CB, (void*) (uintptr_t) (sockNum));
+	// Queue Request in SPI-Task: open -> listen -> enable interrupts run back-to-back
+	if (!SPI_Completion_Init(completion, __openSocket_Complete, &sockets[sockNum]) ||
+			!SPI_Completion_Then(completion, __openSocket_CB) ||
+			!SPI_Completion_Then(completion, __listenSocket_CB) ||
+			!SPI_Completion_Then(completion, __enableSocketInterrupts_CB) ||
+			SPI_Executor_QueueSteps(ethernet_h.spiExecutor, completion, &args, sizeof(args),
+					SPI_PRIO_BULK, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT) == NULL) {
+		// Previous open still pending or the bulk lane stayed full
+		sockets[sockNum].inUse = false;
+		debugEthPrintWithInfoStr(port, sockNum, (uint8_t*) "Open not queued");
+	}
 }
 
-void __openSocket_CB(void* pData) {
-	uint8_t sockNum = (uint8_t) (uintptr_t) pData;
-	SocketHandle_t socket_h = sockets[sockNum];
+int32_t __openSocket_CB(void* pData) {
+	const EthernetSocketArgs_t* args = (const EthernetSocketArgs_t*) pData;
 
 	// Open socket
-	if(socket(sockNum,  socket_h.protocol,  socket_h.port,  socket_h.flag) != sockNum) {
-		socket_h.inUse = false;
-
-		// TODO Error Handling
-		return;
+	int8_t ret = socket(args->sockNum, args->protocol, args->port, args->flag);
+	if(ret != args->sockNum) {
+		return (ret < 0) ? ret : SOCKERR_SOCKNUM;
 	}
 
-	// Listen on socket
-	if(socket_h.protocol == TCP){
-		if(listen(sockNum) != SOCK_OK) {
-			socket_h.inUse = false;
+	return SOCK_OK;
+}
+
+int32_t __listenSocket_CB(void* pData) {
+	const EthernetSocketArgs_t* args = (const EthernetSocketArgs_t*) pData;
 
-			// TODO Error Handling
-			return;
-		}
+	// Only TCP sockets listen
+	if(args->protocol != TCP) {
+		return SOCK_OK;
 	}
 
+	return listen(args->sockNum);
+}
+
+int32_t __enableSocketInterrupts_CB(void* pData) {
+	const EthernetSocketArgs_t* args = (const EthernetSocketArgs_t*) pData;
+
 	// Enable certain interrupts
-	setSn_IMR(sockNum, (Sn_IR_TIMEOUT | Sn_IR_RECV | Sn_IR_DISCON | Sn_IR_CON));
+	setSn_IMR(args->sockNum, (Sn_IR_TIMEOUT | Sn_IR_RECV | Sn_IR_DISCON | Sn_IR_CON));
+	return SOCK_OK;
+}
+
+void __openSocket_Complete(SPI_Completion_t* completion, void* context) {
+	SocketHandle_t* socket_h = (SocketHandle_t*) context;
+
+	if(completion->State != SPI_COMPLETION_DONE) {
+		socket_h->inUse = false;
+		debugEthPrintWithInfoStr(socket_h->port, socket_h->socket_id, (uint8_t*) "Open failed");
+	}
 }
 
 void Ethernet_closeSocket(uint8_t sockNum) {
@@ -197,20 +247,35 @@ void Ethernet_closeSocket(uint8_t sockNum) {
 		return;
 	}
 
+	SPI_Completion_t* completion = &socket_close_requests[sockNum];
+	EthernetSocketArgs_t args = { .sockNum = sockNum };
+
 	// Mark as no longer in use
 	sockets[sockNum].inUse = false;
 
 	// Queue Request in SPI-Task
-	ethernet_h.spiQueueRequest(__closeSocket_CB, (void*) (uintptr_t) sockNum);
+	if (!SPI_Completion_Init(completion, __closeSocket_Complete, &sockets[sockNum]) ||
+			!SPI_Completion_Then(completion, __closeSocket_CB) ||
+			SPI_Executor_QueueSteps(ethernet_h.spiExecutor, completion, &args, sizeof(args),
+					SPI_PRIO_BULK, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT) == NULL) {
+		// Previous close still pending or the bulk lane stayed full
+		sockets[sockNum].inUse = true;
+		debugEthPrintWithInfoStr(sockets[sockNum].port, sockNum, (uint8_t*) "Close not queued");
+	}
 }
 
-void __closeSocket_CB(void* pData) {
-	uint8_t sockNum = (uint8_t) (uintptr_t) pData;
+int32_t __closeSocket_CB(void* pData) {
+	const EthernetSocketArgs_t* args = (const EthernetSocketArgs_t*) pData;
 
-	if(close(sockNum) != SOCK_OK) {
-		// TODO Error Handling
-		sockets[sockNum].inUse = true;
-		return;
+	return close(args->sockNum);
+}
+
+void __closeSocket_Complete(SPI_Completion_t* completion, void* context) {
+	SocketHandle_t* socket_h = (SocketHandle_t*) context;
+
+	if(completion->State != SPI_COMPLETION_DONE) {
+		socket_h->inUse = true;
+		debugEthPrintWithInfoStr(socket_h->port, socket_h->socket_id, (uint8_t*) "Close failed");
 	}
 }
 
@@ -263,6 +328,72 @@ void Ethernet_setRxBufferSize(uint8_t sockNum, uint16_t size) {
 	uint16_t buffer_size = 0;
 }
 
+void Ethernet_dumpSpiStats() {
+	// Formatting and sending runs in the SPI-Task like every other W5500 access
+	if (SPI_Executor_QueueRequest(ethernet_h.spiExecutor, __dumpSpiStats_CB, NULL, SPI_PRIO_BULK) != SPI_REQUEST_OK) {
+		debugEthPrintWithInfoStr(DEBUG_PORT, __Ethernet_getDebugSocket(), (uint8_t*) "Stats not queued");
+	}
+}
+
+void __dumpSpiStats_CB(void* pData) {
+	uint8_t sockNum = __Ethernet_getDebugSocket();
+	SPI_Executor_Stats_t stats;
+	spi_device_stats_t device_stats;
+	SPI_TypeDef* device_inst;
+	uint32_t device_id;
+
+	if(sockNum >= _WIZCHIP_SOCK_NUM_) return;
+
+	BufferHandle_t* buffer = &sockets[sockNum].TX_BUFFER;
+	char* out = (char*) buffer->buffer;
+
+	// One datagram per bus
+	for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+		SPI_Executor_t* executor = SPI_Task_GetExecutorByIndex(spi_idx);
+		if(!SPI_Executor_GetStats(executor, &stats)) continue;
+
+		size_t len = __Ethernet_appendf(out, buffer->size, 0,
+				"SPI%u hw=%lu/%lu isr_hw=%lu dropped=%lu/%lu coalesced=%lu max_wait=%lu max_run=%lu\r\n",
+				spi_idx + 1,
+				stats.HighWater[SPI_PRIO_URGENT], stats.HighWater[SPI_PRIO_BULK], stats.IsrRingHighWater,
+				SPI_Executor_GetDropCount(executor, SPI_PRIO_URGENT), SPI_Executor_GetDropCount(executor, SPI_PRIO_BULK),
+				stats.Coalesced, stats.MaxWaitCycles, stats.MaxRunCycles);
+
+		len = __Ethernet_appendf(out, buffer->size, len, "wait");
+		for(uint8_t bucket = 0; bucket < SPI_STATS_HIST_BUCKETS; bucket++) {
+			len = __Ethernet_appendf(out, buffer->size, len, " %lu", stats.WaitHistogram[bucket]);
+		}
+		len = __Ethernet_appendf(out, buffer->size, len, "\r\nrun ");
+		for(uint8_t bucket = 0; bucket < SPI_STATS_HIST_BUCKETS; bucket++) {
+			len = __Ethernet_appendf(out, buffer->size, len, " %lu", stats.RunHistogram[bucket]);
+		}
+		len = __Ethernet_appendf(out, buffer->size, len, "\r\n");
+
+		for(uint8_t i = 0; i < SPI_STATS_MAX_FUNCTIONS && stats.Functions[i].Function != NULL; i++) {
+			len = __Ethernet_appendf(out, buffer->size, len, "fn %p n=%lu\r\n",
+					stats.Functions[i].Function, stats.Functions[i].Executions);
+		}
+		len = __Ethernet_appendf(out, buffer->size, len, "other n=%lu\r\n", stats.OtherExecutions);
+
+		// Devices on this bus, times in us
+		uint16_t util = SPI_Bus_GetUtilisation(executor->Config->Instance);
+		uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+		len = __Ethernet_appendf(out, buffer->size, len, "util=%u.%u%%\r\n", util / 10, util % 10);
+		for(uint8_t i = 0; SPI_Stats_GetDevice(i, &device_stats, &device_inst, &device_id); i++) {
+			if(device_inst != executor->Config->Instance) continue;
+			len = __Ethernet_appendf(out, buffer->size, len,
+					"dev %lu n=%lu bytes=%lu err=%lu to=%lu retry=%lu late=%lu cfg=%lu wire=%lu wait=%lu\r\n",
+					device_id, device_stats.transactions, (uint32_t) device_stats.bytes,
+					device_stats.errors, device_stats.timeouts, device_stats.retries, device_stats.late,
+					device_stats.reconfigs,
+					(uint32_t) (device_stats.wire_cycles / cycles_per_us),
+					(uint32_t) (device_stats.wait_cycles / cycles_per_us));
+		}
+
+		Ethernet_send(sockNum, buffer->buffer, (uint16_t) len);
+	}
+}
+
 void Ethernet_resetBuffer(BufferHandle_t* buffer) {
 	memset(buffer->buffer, 0, buffer->size);
 }
@@ -277,3 +408,25 @@ uint8_t __Ethernet_getFreeSocket() {
 	return -1;
 }
 
+uint8_t __Ethernet_getDebugSocket() {
+	for(uint8_t sockNum = 0; sockNum < _WIZCHIP_SOCK_NUM_; sockNum++) {
+		if(sockets[sockNum].inUse && sockets[sockNum].port == DEBUG_PORT) return sockNum;
+	}
+
+	return -1;
+}
+
+size_t __Ethernet_appendf(char* buffer, size_t size, size_t len, const char* format, ...) {
+	va_list args;
+
+	if(len >= size) return len;
+
+	va_start(args, format);
+	int written = vsnprintf(&buffer[len], size - len, format, args);
+	va_end(args);
+
+	if(written < 0) return len;
+	// Output was truncated, stop at the buffer end
+	return (len + (size_t) written < size) ? len + (size_t) written : size - 1;
+}
+
@@ -14,20 +14,6 @@
 #include "W5500/w5500.h"
 #include "socket.h"
 
-/**
- * @brief Function pointer type for queuing SPI requests
- * @param requestFunction Function to be executed in SPI task context
- * @param data Parameter to pass to the request function
- */
-typedef void (*spi_queue_request) (Fp_SPI_Queue_Request requestFunction, void* data);
-
-/**
- * @brief Function pointer type for queuing SPI requests from ISR context
- * @param requestFunction Function to be executed in SPI task context
- * @param data Parameter to pass to the request function
- */
-typedef void (*spi_queue_request_fromISR)(Fp_SPI_Queue_Request requestFunction, void* data);
-
 /**
  * @brief Handle for managing data buffers
  */
@@ -37,11 +23,10 @@ typedef struct {
 } BufferHandle_t;
 
 /**
- * @brief Internal ethernet interface handle containing SPI queue functions
+ * @brief Internal ethernet interface handle containing the SPI executor of the W5500 bus
  */
 typedef struct ethernet_interface_handle {
-  spi_queue_request         spiQueueRequest;         /**< Queue request from normal context */
-  spi_queue_request_fromISR spiQueueRequest_fromISR; /**< Queue request from ISR context */
+  SPI_Executor_t* spiExecutor; /**< Executor the SPI requests are queued in */
 } EthernetInterface_t;
 
 /**
@@ -62,11 +47,23 @@ typedef struct {
   uint8_t             flag;             /**< Socket flags */
   uint8_t             socket_id;        /**< Socket number (0-7) */
   BufferHandle_t      RX_BUFFER;        /**< Receive buffer */
-  BufferHandle_t      TX_BUFFER;        /**< Transmit buffer (currently unused) */
+  BufferHandle_t      TX_BUFFER;        /**< Transmit buffer (used for statistics output) */
   void*               SocketCallbackFP; /**< Callback function pointer */
   bool                inUse;            /**< Socket in use flag */
 } SocketHandle_t;
 
+/**
+ * @brief Socket parameters copied into a queued SPI request
+ *
+ * Steps read their parameters from this copy instead of the shared socket table.
+ */
+typedef struct {
+  uint8_t  sockNum;  /**< Socket number (0-7) */
+  uint8_t  protocol; /**< Protocol used by this socket */
+  uint8_t  flag;     /**< Socket flags */
+  uint16_t port;     /**< Port number */
+} EthernetSocketArgs_t;
+
 /**
  * @brief Socket events passed to callback functions
  */
@@ -93,7 +90,7 @@ typedef void (*SocketCallbackFunction) (SocketHandle_t socket, SocketEvent_t eve
 /**
  * @brief Initialize the ethernet interface
  *
- * Sets up SPI queue functions, registers interrupt callback, loads default
+ * Looks up the SPI executor, registers interrupt callback, loads default
  * configuration, and partitions RX/TX buffers for all sockets.
  */
 void Ethernet_Init();
@@ -116,7 +113,8 @@ void Ethernet_initPort(uint16_t port, EthernetProtocol_t protocol, SocketCallbac
  * @param DI Digital input that triggered
  * @param edge Trigger edge (rising/falling)
  *
- * Queues the actual interrupt handler in SPI task context.
+ * Queues the actual interrupt handler in the urgent lane of the SPI task.
+ * The request is idempotent, edges arriving while it is pending are coalesced.
  */
 void Ethernet_IRQ_Callback(uint8_t ID, GPIO_DI_TypeDef DI, PinTriggerEdge_TypeDef edge);
 
@@ -137,29 +135,61 @@ void __IRQ_Callback_CB(void* pData);
  * @param port Port number
  * @param flag Socket flags
  *
- * Queues socket opening in SPI task. For TCP sockets, also starts listening.
+ * Queues opening, listening (TCP only) and enabling the socket interrupts as one
+ * step sequence in the SPI task. The socket is released again if a step fails.
  */
 void Ethernet_openSocket(uint8_t sockNum, uint8_t protocol, uint16_t port, uint8_t flag);
 
 /**
- * @brief SPI task callback for opening socket
- * @param pData Socket number as void pointer
+ * @brief SPI task step for opening socket
+ * @param pData Pointer to the request's EthernetSocketArgs_t
+ * @return SOCK_OK or negative socket error
+ */
+int32_t __openSocket_CB(void* pData);
+
+/**
+ * @brief SPI task step for listening on a TCP socket, no-op for other protocols
+ * @param pData Pointer to the request's EthernetSocketArgs_t
+ * @return SOCK_OK or negative socket error
+ */
+int32_t __listenSocket_CB(void* pData);
+
+/**
+ * @brief SPI task step enabling the socket interrupts
+ * @param pData Pointer to the request's EthernetSocketArgs_t
+ * @return SOCK_OK
+ */
+int32_t __enableSocketInterrupts_CB(void* pData);
+
+/**
+ * @brief Called in SPI task context when the open sequence has finished
+ * @param completion Completion of the sequence
+ * @param context Socket handle of the request
  */
-void __openSocket_CB(void* pData);
+void __openSocket_Complete(SPI_Completion_t* completion, void* context);
 
 /**
  * @brief Close a socket
  * @param sockNum Socket number to close
  *
  * Marks socket as not in use and queues close operation in SPI task.
+ * The socket is marked as in use again if closing fails.
  */
 void Ethernet_closeSocket(uint8_t sockNum);
 
 /**
- * @brief SPI task callback for closing socket
- * @param pData Socket number as void pointer
+ * @brief SPI task step for closing socket
+ * @param pData Pointer to the request's EthernetSocketArgs_t
+ * @return SOCK_OK or negative socket error
  */
-void __closeSocket_CB(void* pData);
+int32_t __closeSocket_CB(void* pData);
+
+/**
+ * @brief Called in SPI task context when closing has finished
+ * @param completion Completion of the close request
+ * @param context Socket handle of the request
+ */
+void __closeSocket_Complete(SPI_Completion_t* completion, void* context);
 
 /* ========== Data Transfer ========== */
 
@@ -198,6 +228,28 @@ void Ethernet_resetBuffer(BufferHandle_t* rx_buffer);
  */
 void Ethernet_setBufferSize(BufferHandle_t* buffer, uint16_t size);
 
+/* ========== Diagnostics ========== */
+
+#define ETHERNET_CMD_SPI_STATS "spistats" /**< Datagram on DEBUG_PORT that requests Ethernet_dumpSpiStats() */
+
+/**
+ * @brief Send the SPI executor statistics over the debug socket
+ *
+ * Queues __dumpSpiStats_CB in the SPI task. Nothing is sent if no socket is
+ * open on DEBUG_PORT. Called on ETHERNET_CMD_SPI_STATS received on DEBUG_PORT.
+ */
+void Ethernet_dumpSpiStats();
+
+/**
+ * @brief SPI task callback formatting and sending the statistics of every bus
+ * @param pData Unused parameter
+ *
+ * Sends one datagram per bus: lane high-water marks, drop and coalesce counters,
+ * wait/run histograms (see SPI_Stats_BucketCycles()), executions per function,
+ * the bus utilisation and the counters of every registered device on the bus.
+ */
+void __dumpSpiStats_CB(void* pData);
+
 /* ========== Network Configuration ========== */
 
 /**
@@ -220,4 +272,20 @@ wiz_NetInfo* Ethernet_getNetworkInfo();
  */
 uint8_t __Ethernet_getFreeSocket();
 
+/**
+ * @brief Find the open socket on DEBUG_PORT
+ * @return Socket number (0-7), or -1 if no debug socket is open
+ */
+uint8_t __Ethernet_getDebugSocket();
+
+/**
+ * @brief Append formatted text to a buffer, truncating at its end
+ * @param buffer Output buffer
+ * @param size Size of the buffer in bytes
+ * @param len Current length of the text in the buffer
+ * @param format printf-style format
+ * @return New length of the text
+ */
+size_t __Ethernet_appendf(char* buffer, size_t size, size_t len, const char* format, ...);
+
 #endif /* APP_INC_ETHERNET_INTERFACE_H_ */
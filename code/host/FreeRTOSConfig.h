@@ -0,0 +1,38 @@
+/*
+ * FreeRTOSConfig.h
+ *
+ *  Host build: FreeRTOS POSIX port (portable/ThirdParty/GCC/Posix) with heap_3
+ */
+
+#ifndef HOST_FREERTOS_CONFIG_H_
+#define HOST_FREERTOS_CONFIG_H_
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION 0
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configTICK_RATE_HZ                      ((TickType_t) 1000)
+#define configMAX_PRIORITIES                    7
+#define configMINIMAL_STACK_SIZE                ((unsigned short) 128)
+#define configTOTAL_HEAP_SIZE                   ((size_t) (1024 * 1024))
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_16_BIT_TICKS                  0
+#define configUSE_MUTEXES                       1
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configQUEUE_REGISTRY_SIZE               8
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_TRACE_FACILITY                0
+#define configUSE_TIMERS                        0
+
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_vTaskDelete                     1
+
+#define configASSERT(x) if((x) == 0) { vAssertCalled(__FILE__, __LINE__); }
+void vAssertCalled(const char* file, unsigned long line);
+
+#endif /* HOST_FREERTOS_CONFIG_H_ */
@@ -0,0 +1,49 @@
+/*
+ * cmsis_os_host.c
+ *
+ *  The CMSIS-OS (v1) semaphore subset used by the SPI layer, implemented on
+ *  plain FreeRTOS for the host build. The Cube cmsis_os.c can't be used there,
+ *  it reads IPSR to tell task from interrupt context.
+ */
+
+#include "cmsis_os.h"
+#include "semphr.h"
+
+osSemaphoreId osSemaphoreCreate(const osSemaphoreDef_t* semaphore_def, int32_t count)
+{
+  SemaphoreHandle_t sema;
+  UNUSED(semaphore_def);
+
+  // Same as the target: count 1 creates a binary semaphore that is available
+  if(count == 1) {
+    sema = xSemaphoreCreateBinary();
+    if(sema != NULL) xSemaphoreGive(sema);
+  }
+  else {
+    sema = xSemaphoreCreateCounting(count, count);
+  }
+
+  return (osSemaphoreId) sema;
+}
+
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec)
+{
+  TickType_t ticks = (millisec == osWaitForever) ? portMAX_DELAY : pdMS_TO_TICKS(millisec);
+
+  if(semaphore_id == NULL) return osErrorParameter;
+
+  return (xSemaphoreTake((SemaphoreHandle_t) semaphore_id, ticks) == pdTRUE) ? osOK : osErrorOS;
+}
+
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id)
+{
+  if(semaphore_id == NULL) return osErrorParameter;
+
+  return (xSemaphoreGive((SemaphoreHandle_t) semaphore_id) == pdTRUE) ? osOK : osErrorOS;
+}
+
+osStatus osDelay(uint32_t millisec)
+{
+  vTaskDelay(pdMS_TO_TICKS(millisec));
+  return osOK;
+}
@@ -0,0 +1,14 @@
+/*
+ * display.h
+ *
+ *  Host build: error texts go to stderr instead of the display
+ */
+
+#ifndef HOST_DISPLAY_H_
+#define HOST_DISPLAY_H_
+
+#include <stdint.h>
+
+void displayBlocking(const char* text, uint32_t duration_ms);
+
+#endif /* HOST_DISPLAY_H_ */
@@ -0,0 +1,417 @@
+/*
+ * hal_spi_host.c
+ *
+ *  Host replacement for the STM32 SPI/GPIO/RCC HAL, see hal_spi_host.h
+ */
+
+#include "hal_spi_host.h"
+#include "spi.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum
+{
+  HOST_XFER_TX = 0,
+  HOST_XFER_RX,
+  HOST_XFER_TXRX
+}host_xfer_t;
+
+typedef struct __Host_Slot_TypeDef
+{
+  HAL_SPI_Host_Model_t* model;
+  GPIO_TypeDef*         cs_port;
+  uint16_t              cs_pin;
+  GPIO_PinState         cs_active;
+  bool                  selected;
+}host_slot_t;
+
+typedef struct __Host_Bus_TypeDef
+{
+  SPI_HandleTypeDef     handle;
+  DMA_HandleTypeDef     dma_rx;
+  DMA_HandleTypeDef     dma_tx;
+  TaskHandle_t          task;
+
+  // Transfer handed to the model task
+  host_xfer_t           kind;
+  const uint8_t*        tx;
+  uint8_t*              rx;
+  uint16_t              len;
+  bool                  fail;
+
+  // Fault injection, see HAL_SPI_Host_FailTransfer()
+  bool                  fail_armed;
+  uint32_t              fail_skip;
+  bool                  stall_armed; // see HAL_SPI_Host_StallTransfer()
+
+  uint32_t              bit_rate; // 0: from PCLK and prescaler
+  HAL_SPI_Host_Stats_t  stats;
+
+  host_slot_t           slots[HAL_SPI_HOST_MAX_MODELS];
+  uint8_t               slot_count;
+}host_bus_t;
+
+static host_bus_t host_buses[SPI_BUS_COUNT];
+
+uint32_t SystemCoreClock = HAL_SPI_HOST_CORE_CLOCK_HZ;
+
+static SPI_TypeDef* const host_instances[SPI_BUS_COUNT] = { SPI1, SPI2, SPI3, SPI4, SPI5, SPI6 };
+
+static void host_bus_task(void* pvParameters);
+
+// Helper Functions
+static host_bus_t* host_get_bus(SPI_TypeDef* instance) {
+  uint8_t spi_idx = get_spi_index(instance);
+
+  if(spi_idx >= SPI_BUS_COUNT) return NULL;
+  return &host_buses[spi_idx];
+}
+
+static inline bool host_clk_is_pclk2(SPI_TypeDef* instance) {
+  return instance == SPI1 || instance == SPI4 || instance == SPI5 || instance == SPI6;
+}
+
+static uint32_t host_bus_bit_rate(host_bus_t* bus) {
+  uint32_t pclk;
+
+  if(bus->bit_rate != 0) return bus->bit_rate;
+
+  pclk = host_clk_is_pclk2(bus->handle.Instance) ? HAL_SPI_HOST_PCLK2_HZ : HAL_SPI_HOST_PCLK1_HZ;
+  // BR = n divides PCLK by 2^(n+1)
+  return pclk >> (((bus->handle.Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+}
+
+static void host_sleep_ns(uint64_t ns) {
+  struct timespec remaining = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+
+  // The POSIX port's tick signal interrupts the sleep
+  while(nanosleep(&remaining, &remaining) != 0 && errno == EINTR);
+}
+
+// Shifts one byte through every selected model, unselected ones leave MISO floating high
+static uint8_t host_bus_exchange(host_bus_t* bus, uint8_t mosi) {
+  uint8_t miso = 0xFF;
+
+  for(uint8_t i = 0; i < bus->slot_count; i++) {
+    host_slot_t* slot = &bus->slots[i];
+
+    if(slot->selected) miso &= slot->model->Exchange(slot->model, mosi);
+  }
+  return miso;
+}
+
+// Occupies the bus for the duration of the transfer plus overhead_ns and exchanges the bytes with the models.
+// A receive clocks out the old content of the buffer like the HAL in full duplex master mode.
+static void host_bus_clock(host_bus_t* bus, host_xfer_t kind, const uint8_t* tx, uint8_t* rx, uint16_t len,
+    uint64_t overhead_ns) {
+  uint64_t busy_ns = (uint64_t) len * 8U * 1000000000ULL / host_bus_bit_rate(bus);
+
+  // One sleep, each one costs the host far more than the modelled overhead
+  host_sleep_ns(busy_ns + overhead_ns);
+
+  for(uint16_t i = 0; i < len; i++) {
+    uint8_t mosi = 0xFF;
+    uint8_t miso;
+
+    if(kind != HOST_XFER_RX && tx != NULL) mosi = tx[i];
+    else if(rx != NULL) mosi = rx[i];
+
+    miso = host_bus_exchange(bus, mosi);
+    if(kind != HOST_XFER_TX && rx != NULL) rx[i] = miso;
+  }
+
+  bus->stats.Transfers++;
+  bus->stats.Bytes += len;
+  bus->stats.BusyNs += busy_ns;
+}
+
+// Consumes the injected fault once its transfer comes up
+static bool host_bus_fail(host_bus_t* bus) {
+  if(!bus->fail_armed) return false;
+  if(bus->fail_skip != 0) {
+    bus->fail_skip--;
+    return false;
+  }
+  bus->fail_armed = false;
+  return true;
+}
+
+static HAL_StatusTypeDef host_bus_transfer(SPI_HandleTypeDef* hspi, host_xfer_t kind, const uint8_t* tx, uint8_t* rx, uint16_t len) {
+  host_bus_t* bus = host_get_bus(hspi->Instance);
+
+  if(bus == NULL || len == 0) return HAL_ERROR;
+  if(hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+
+  // The CPU services the FIFO byte by byte, SCK pauses in between
+  if(host_bus_fail(bus)) {
+    host_bus_clock(bus, kind, tx, rx, len / 2, (uint64_t) (len / 2) * HAL_SPI_HOST_POLLED_GAP_NS);
+    return HAL_ERROR;
+  }
+  host_bus_clock(bus, kind, tx, rx, len, (uint64_t) len * HAL_SPI_HOST_POLLED_GAP_NS);
+  return HAL_OK;
+}
+
+static HAL_StatusTypeDef host_bus_start(SPI_HandleTypeDef* hspi, host_xfer_t kind, const uint8_t* tx, uint8_t* rx, uint16_t len) {
+  host_bus_t* bus = host_get_bus(hspi->Instance);
+
+  if(bus == NULL || bus->task == NULL || len == 0) return HAL_ERROR;
+  if(hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+
+  hspi->State = HAL_SPI_STATE_BUSY;
+  bus->kind = kind;
+  bus->tx = tx;
+  bus->rx = rx;
+  bus->len = len;
+  bus->fail = host_bus_fail(bus);
+
+  // Started but never clocked, only HAL_SPI_Abort*() ends it
+  if(bus->stall_armed) {
+    bus->stall_armed = false;
+    return HAL_OK;
+  }
+  xTaskNotifyGive(bus->task);
+  return HAL_OK;
+}
+
+// Plays the DMA controller and its transfer complete interrupt
+static void host_bus_task(void* pvParameters) {
+  host_bus_t* bus = (host_bus_t*) pvParameters;
+
+  while(1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if(bus->fail) {
+      host_bus_clock(bus, bus->kind, bus->tx, bus->rx, bus->len / 2, HAL_SPI_HOST_DMA_SETUP_NS);
+      bus->handle.ErrorCode |= HAL_SPI_ERROR_DMA;
+      bus->handle.State = HAL_SPI_STATE_READY;
+      HAL_SPI_ErrorCallback(&bus->handle);
+      continue;
+    }
+
+    host_bus_clock(bus, bus->kind, bus->tx, bus->rx, bus->len, HAL_SPI_HOST_DMA_SETUP_NS);
+    bus->handle.State = HAL_SPI_STATE_READY;
+
+    switch(bus->kind) {
+    case HOST_XFER_TX:
+      HAL_SPI_TxCpltCallback(&bus->handle);
+      break;
+    case HOST_XFER_RX:
+      HAL_SPI_RxCpltCallback(&bus->handle);
+      break;
+    case HOST_XFER_TXRX:
+      HAL_SPI_TxRxCpltCallback(&bus->handle);
+      break;
+    }
+  }
+}
+
+void HAL_SPI_Host_Init(void)
+{
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    host_bus_t* bus = &host_buses[spi_idx];
+
+    bus->handle.Instance = host_instances[spi_idx];
+    bus->handle.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_16;
+    bus->handle.State = HAL_SPI_STATE_READY;
+    // DMA streams are attached so the drivers take their DMA paths
+    bus->handle.hdmarx = &bus->dma_rx;
+    bus->handle.hdmatx = &bus->dma_tx;
+
+    xTaskCreate(host_bus_task, "SPI_Host_DMA", HAL_SPI_HOST_TASK_STACK_SIZE, (void*) bus,
+                HAL_SPI_HOST_TASK_PRIORITY, &bus->task);
+  }
+}
+
+void HAL_SPI_Host_SetBitRate(SPI_TypeDef* instance, uint32_t bits_per_second)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  if(bus != NULL) bus->bit_rate = bits_per_second;
+}
+
+uint32_t HAL_SPI_Host_GetBitRate(SPI_TypeDef* instance)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  return (bus != NULL) ? host_bus_bit_rate(bus) : 0;
+}
+
+bool HAL_SPI_Host_Attach(SPI_TypeDef* instance, GPIO_TypeDef* cs_port, uint16_t cs_pin, GPIO_PinState cs_active,
+                         HAL_SPI_Host_Model_t* model)
+{
+  host_bus_t* bus = host_get_bus(instance);
+  host_slot_t* slot;
+
+  if(bus == NULL || model == NULL || bus->slot_count >= HAL_SPI_HOST_MAX_MODELS) return false;
+
+  slot = &bus->slots[bus->slot_count++];
+  slot->model = model;
+  slot->cs_port = cs_port;
+  slot->cs_pin = cs_pin;
+  slot->cs_active = cs_active;
+  slot->selected = false;
+  return true;
+}
+
+void HAL_SPI_Host_FailTransfer(SPI_TypeDef* instance, uint32_t skip)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  if(bus == NULL) return;
+  bus->fail_skip = skip;
+  bus->fail_armed = true;
+}
+
+void HAL_SPI_Host_StallTransfer(SPI_TypeDef* instance)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  if(bus == NULL) return;
+  bus->stall_armed = true;
+}
+
+void HAL_SPI_Host_DetachAll(void)
+{
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    host_buses[spi_idx].slot_count = 0;
+  }
+}
+
+void HAL_SPI_Host_GetStats(SPI_TypeDef* instance, HAL_SPI_Host_Stats_t* stats)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  if(bus != NULL && stats != NULL) *stats = bus->stats;
+}
+
+void HAL_SPI_Host_ResetStats(SPI_TypeDef* instance)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  if(bus != NULL) memset(&bus->stats, 0, sizeof(bus->stats));
+}
+
+// spi.h (CubeMX)
+SPI_HandleTypeDef* SPI_Init(SPI_TypeDef* instance)
+{
+  host_bus_t* bus = host_get_bus(instance);
+
+  return (bus != NULL) ? &bus->handle : NULL;
+}
+
+// RCC
+uint32_t HAL_RCC_GetPCLK1Freq(void)
+{
+  return HAL_SPI_HOST_PCLK1_HZ;
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void)
+{
+  return HAL_SPI_HOST_PCLK2_HZ;
+}
+
+uint32_t HAL_GetTick(void)
+{
+  return (uint32_t) (xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+// GPIO, only Chip-Select edges of attached models have an effect
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init)
+{
+  UNUSED(GPIOx);
+  UNUSED(GPIO_Init);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    host_bus_t* bus = &host_buses[spi_idx];
+
+    for(uint8_t i = 0; i < bus->slot_count; i++) {
+      host_slot_t* slot = &bus->slots[i];
+      bool selected = (PinState == slot->cs_active);
+
+      if(slot->cs_port != GPIOx || (slot->cs_pin & GPIO_Pin) == 0 || slot->selected == selected) continue;
+
+      slot->selected = selected;
+      if(selected && slot->model->Select != NULL) slot->model->Select(slot->model);
+      if(!selected && slot->model->Deselect != NULL) slot->model->Deselect(slot->model);
+    }
+  }
+}
+
+// SPI
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi)
+{
+  if(host_get_bus(hspi->Instance) == NULL) return HAL_ERROR;
+
+  hspi->State = HAL_SPI_STATE_READY;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  UNUSED(Timeout);
+  return host_bus_transfer(hspi, HOST_XFER_TX, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  UNUSED(Timeout);
+  return host_bus_transfer(hspi, HOST_XFER_RX, NULL, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size, uint32_t Timeout)
+{
+  UNUSED(Timeout);
+  return host_bus_transfer(hspi, HOST_XFER_TXRX, pTxData, pRxData, Size);
+}
+
+// The model never hangs, an abort only has to report completion
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi)
+{
+  hspi->State = HAL_SPI_STATE_READY;
+  hspi->ErrorCode = HAL_SPI_ERROR_NONE;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort_IT(SPI_HandleTypeDef* hspi)
+{
+  HAL_SPI_Abort(hspi);
+  HAL_SPI_AbortCpltCallback(hspi);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_TX, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_RX, NULL, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_TXRX, pTxData, pRxData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_TX, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_RX, NULL, pData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size)
+{
+  return host_bus_start(hspi, HOST_XFER_TXRX, pTxData, pRxData, Size);
+}
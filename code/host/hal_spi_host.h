@@ -0,0 +1,88 @@
+/*
+ * hal_spi_host.h
+ *
+ *  Host (Linux) replacement for the STM32 SPI/GPIO/RCC HAL, used to run the
+ *  SPI task layer on the FreeRTOS POSIX port for benchmarking.
+ *
+ *  The HAL sources are replaced by hal_spi_host.c, the HAL and CMSIS types by
+ *  stubs/stm32f7xx_hal.h. stubs/ also stands in for the firmware headers that
+ *  are not part of this tree and for the WIZnet ioLibrary (register level, on
+ *  top of w5500.c), so w5500.c and ethernet_interface.c build unchanged.
+ *  Build with CMakeLists.txt, which fetches the FreeRTOS kernel for the POSIX
+ *  port:
+ *
+ *    cmake -S code/host -B build/host && cmake --build build/host
+ *
+ *  Devices: models are attached to a bus and a Chip-Select pin with
+ *  HAL_SPI_Host_Attach(), spi_models_host.c has the ones of the board. A model
+ *  sees the CS edges written by HAL_GPIO_WritePin() and exchanges every byte
+ *  clocked while it is selected. MISO idles high (0xFF) when nothing drives it.
+ *
+ *  Bus model: every transfer occupies the bus for len * 8 / bit rate. The bit
+ *  rate follows from PCLK and the prescaler loaded by HAL_SPI_Init() unless it
+ *  is overridden with HAL_SPI_Host_SetBitRate(). Polled transfers add
+ *  HAL_SPI_HOST_POLLED_GAP_NS per byte, _IT and _DMA ones
+ *  HAL_SPI_HOST_DMA_SETUP_NS per transfer, so polling wins short transfers and
+ *  the calibration finds the crossover. _IT and _DMA transfers
+ *  complete asynchronously in a model task per bus which then calls the
+ *  HAL_SPI_*CpltCallback() like the DMA interrupt would.
+ */
+
+#ifndef HOST_HAL_SPI_HOST_H_
+#define HOST_HAL_SPI_HOST_H_
+
+#include "spi_devices.h"
+
+#define HAL_SPI_HOST_PCLK1_HZ         54000000U
+#define HAL_SPI_HOST_PCLK2_HZ         108000000U
+#define HAL_SPI_HOST_CORE_CLOCK_HZ    216000000U
+#define HAL_SPI_HOST_TASK_PRIORITY    (configMAX_PRIORITIES - 1) // Completion "interrupts" preempt everything
+#define HAL_SPI_HOST_TASK_STACK_SIZE  (configMINIMAL_STACK_SIZE * 2)
+
+#define HAL_SPI_HOST_MAX_MODELS       4 // Per bus
+#define HAL_SPI_HOST_POLLED_GAP_NS    1000 // SCK pause per byte of a polled transfer (FIFO serviced by the CPU)
+#define HAL_SPI_HOST_DMA_SETUP_NS     3000 // Stream setup, cache maintenance and completion interrupt of a _DMA/_IT transfer
+
+typedef struct __HAL_SPI_Host_Model_TypeDef HAL_SPI_Host_Model_t;
+
+/**
+ * Device on the modelled bus, embedded as first member of the model state.
+ * The functions run in the context that clocks the bus (caller or model task).
+ */
+struct __HAL_SPI_Host_Model_TypeDef
+{
+  const char* Name;
+  void    (*Select)(HAL_SPI_Host_Model_t* model);               // CS asserted, a frame starts
+  uint8_t (*Exchange)(HAL_SPI_Host_Model_t* model, uint8_t mosi); // One byte, returns MISO
+  void    (*Deselect)(HAL_SPI_Host_Model_t* model);             // CS released, the frame ends
+};
+
+typedef struct __HAL_SPI_Host_Stats_TypeDef
+{
+  uint32_t Transfers;
+  uint64_t Bytes;
+  uint64_t BusyNs;    // Time the modelled bus was clocking
+}HAL_SPI_Host_Stats_t;
+
+// Creates the model tasks, call before the scheduler starts
+void HAL_SPI_Host_Init(void);
+
+// 0: derive the bit rate from PCLK and prescaler again
+void HAL_SPI_Host_SetBitRate(SPI_TypeDef* instance, uint32_t bits_per_second);
+uint32_t HAL_SPI_Host_GetBitRate(SPI_TypeDef* instance);
+
+// cs_active: pin state that selects the device. Returns false if the bus is full
+bool HAL_SPI_Host_Attach(SPI_TypeDef* instance, GPIO_TypeDef* cs_port, uint16_t cs_pin, GPIO_PinState cs_active,
+                         HAL_SPI_Host_Model_t* model);
+void HAL_SPI_Host_DetachAll(void);
+
+// Fault injection: the transfer after the next skip ones on the bus stops halfway and fails,
+// polled with HAL_ERROR, DMA/IT with HAL_SPI_ErrorCallback() like a DMA transfer error
+void HAL_SPI_Host_FailTransfer(SPI_TypeDef* instance, uint32_t skip);
+// Fault injection: the next DMA/IT transfer on the bus hangs until it is aborted
+void HAL_SPI_Host_StallTransfer(SPI_TypeDef* instance);
+
+void HAL_SPI_Host_GetStats(SPI_TypeDef* instance, HAL_SPI_Host_Stats_t* stats);
+void HAL_SPI_Host_ResetStats(SPI_TypeDef* instance);
+
+#endif /* HOST_HAL_SPI_HOST_H_ */
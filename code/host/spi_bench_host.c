@@ -0,0 +1,690 @@
+/*
+ * spi_bench_host.c
+ *
+ *  Throughput and latency benchmark of the SPI task layer on the host build.
+ *  Every executor with a configured bus gets BENCH_REQUESTS requests of
+ *  BENCH_TRANSFER_SIZE bytes, all buses run at the same time. Results are
+ *  printed per bus: requests/s, bytes/s, bus utilisation and the executor
+ *  latency statistics.
+ *
+ *  Usage: spi_bench_host [requests] [transfer size] [bit rate]
+ *         spi_bench_host threshold [bit rate]
+ *         spi_bench_host models
+ *         spi_bench_host isr
+ *         spi_bench_host urgent [transfer size] [bit rate]
+ *
+ *  The threshold mode compares polled and DMA transactions/s per transfer
+ *  length (see SPI_Bus_MeasureTransactions()) and runs the calibration.
+ *  The models mode attaches the device models of the board (spi_models_host.c)
+ *  and runs a register level check of each through the SPI layer, the W5500
+ *  also through its driver (w5500.c), the exit code is the number of failed
+ *  checks.
+ *  The isr mode lets BENCH_ISR_PRODUCERS tasks of two priorities emulate the
+ *  interrupts of a bus and queue bursts into its ISR ring, faster than the
+ *  SPI Task drains it. Every request carries its producer and sequence number,
+ *  it checks that none is executed twice, none is lost without being counted
+ *  as dropped and each producer's requests run in order per lane.
+ *  The urgent mode keeps BENCH_URGENT_BACKLOG bulk requests queued and measures
+ *  enqueue -> start of urgent requests queued in between. No urgent request may
+ *  wait longer than one bulk transfer on the bus plus BENCH_URGENT_MARGIN_US.
+ */
+
+#include "hal_spi_host.h"
+#include "spi_models_host.h"
+#include "spi_task.h"
+#include "display.h"
+#include "generic_bus_device_datatypes.h"
+#include "W5500/w5500.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REQUESTS        10000
+#define BENCH_TRANSFER_SIZE   32
+#define BENCH_MAX_TRANSFER    1024
+#define BENCH_TASK_PRIORITY   (SPI_TASK_PRIORITY + 1)
+#define BENCH_ISR_PRODUCERS   4
+#define BENCH_ISR_REQUESTS    2000 // Per producer
+#define BENCH_ISR_BURST       8    // Requests per interrupt burst, bursts of all producers overflow the ring
+#define BENCH_ISR_DRAIN_MS    2000
+#define BENCH_URGENT_REQUESTS 200
+#define BENCH_URGENT_BACKLOG  (SPI_QUEUE_SIZE / 2) // Bulk requests kept queued
+#define BENCH_URGENT_SIZE     512  // Default bulk transfer size of the urgent mode
+#define BENCH_URGENT_MARGIN_US 500 // Scheduling and the urgent request's own transfer
+
+typedef struct __Bench_Bus_TypeDef
+{
+  spi_device_t      device;
+  SPI_Executor_t*   executor;
+  uint8_t           tx[BENCH_MAX_TRANSFER];
+  uint8_t           rx[BENCH_MAX_TRANSFER];
+  volatile uint32_t done;
+}bench_bus_t;
+
+static bench_bus_t bench_buses[SPI_BUS_COUNT];
+static uint32_t bench_requests = BENCH_REQUESTS;
+static uint16_t bench_transfer_size = BENCH_TRANSFER_SIZE;
+static uint32_t bench_bit_rate;
+
+static spi_models_board_t bench_board;
+
+// Inline arguments of the isr mode requests
+typedef struct __Bench_Isr_Args_TypeDef
+{
+  uint8_t  producer;
+  uint8_t  priority;
+  uint16_t seq;
+}bench_isr_args_t;
+
+static bench_bus_t* bench_stress_bus;
+static uint8_t bench_isr_executed[BENCH_ISR_PRODUCERS][BENCH_ISR_REQUESTS];
+static bool bench_isr_accepted[BENCH_ISR_PRODUCERS][BENCH_ISR_REQUESTS];
+static uint16_t bench_isr_next[BENCH_ISR_PRODUCERS][SPI_PRIO_COUNT]; // Lowest sequence number still in order
+static uint32_t bench_isr_reordered;
+static volatile uint32_t bench_isr_executions;
+static volatile uint32_t bench_isr_producers_done;
+
+static volatile uint32_t bench_urgent_done;
+static uint64_t bench_urgent_max_wait_ns;
+
+static SPI_TypeDef* const bench_instances[SPI_BUS_COUNT] = { SPI1, SPI2, SPI3, SPI4, SPI5, SPI6 };
+
+void displayBlocking(const char* text, uint32_t duration_ms)
+{
+  UNUSED(duration_ms);
+  fprintf(stderr, "%s\n", text);
+}
+
+void vAssertCalled(const char* file, unsigned long line)
+{
+  fprintf(stderr, "assert failed: %s:%lu\n", file, line);
+  abort();
+}
+
+static uint64_t bench_now_ns(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+// Request executed by the SPI Task: one CS frame, full duplex
+static void bench_transfer_CB(void* Handle) {
+  bench_bus_t* bus = (bench_bus_t*) Handle;
+  spi_segment_t segment = { .tx = bus->tx, .rx = bus->rx, .len = bench_transfer_size };
+
+  SPI_Device_Transfer(&bus->device, &segment, 1);
+  bus->done++;
+}
+
+static void bench_report(uint8_t spi_idx, uint64_t elapsed_ns) {
+  bench_bus_t* bus = &bench_buses[spi_idx];
+  HAL_SPI_Host_Stats_t bus_stats;
+  SPI_Executor_Stats_t stats;
+  spi_device_stats_t device_stats;
+  uint16_t util = SPI_Bus_GetUtilisation(bench_instances[spi_idx]);
+  double seconds = (double) elapsed_ns / 1e9;
+
+  HAL_SPI_Host_GetStats(bench_instances[spi_idx], &bus_stats);
+  SPI_Executor_GetStats(bus->executor, &stats);
+  SPI_Stats_Get(&bus->device.stats, &device_stats);
+
+  printf("SPI%u: %lu requests in %.3f s, %.0f requests/s, %.0f bytes/s, bus %lu bit/s busy %.1f %%\n",
+         spi_idx + 1, (unsigned long) bus->done, seconds,
+         bus->done / seconds, (double) bus_stats.Bytes / seconds,
+         (unsigned long) HAL_SPI_Host_GetBitRate(bench_instances[spi_idx]),
+         100.0 * (double) bus_stats.BusyNs / (double) elapsed_ns);
+  printf("SPI%u: max wait %lu cycles, max run %lu cycles, queue high water %lu/%lu, dropped %lu\n",
+         spi_idx + 1, (unsigned long) stats.MaxWaitCycles, (unsigned long) stats.MaxRunCycles,
+         (unsigned long) stats.HighWater[SPI_PRIO_URGENT], (unsigned long) stats.HighWater[SPI_PRIO_BULK],
+         (unsigned long) SPI_Executor_GetDropCount(bus->executor, SPI_PRIO_BULK));
+  printf("SPI%u: device %lu transactions, %lu errors, %lu timeouts, %lu retries, wire %.3f s, lock wait %.3f s, utilisation %u.%u %% (last %u ms)\n",
+         spi_idx + 1, (unsigned long) device_stats.transactions, (unsigned long) device_stats.errors,
+         (unsigned long) device_stats.timeouts, (unsigned long) device_stats.retries,
+         (double) device_stats.wire_cycles / SystemCoreClock, (double) device_stats.wait_cycles / SystemCoreClock,
+         util / 10, util % 10, SPI_UTIL_WINDOW_MS);
+}
+
+static void bench_threshold_task(void* pvParameters) {
+  UNUSED(pvParameters);
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    bench_bus_t* bus = &bench_buses[spi_idx];
+
+    if(bus->executor == NULL) continue;
+
+    printf("SPI%u: %lu bit/s\n%6s %14s %14s\n", spi_idx + 1,
+           (unsigned long) HAL_SPI_Host_GetBitRate(bench_instances[spi_idx]), "bytes", "polled tps", "dma tps");
+    for(uint16_t len = 1; len <= SPI_CALIBRATION_MAX_LEN; len <<= 1) {
+      printf("%6u %14lu %14lu\n", len,
+             (unsigned long) SPI_Bus_MeasureTransactions(bus->device.spi_h, NULL, len, bench_requests, true),
+             (unsigned long) SPI_Bus_MeasureTransactions(bus->device.spi_h, NULL, len, bench_requests, false));
+    }
+    printf("SPI%u: calibrated polled threshold %u bytes\n", spi_idx + 1,
+           SPI_Device_CalibratePolledThreshold(&bus->device));
+  }
+
+  exit(0);
+}
+
+static void bench_model_device(spi_device_t* device, SPI_TypeDef* instance, GPIO_TypeDef* cs_port, uint16_t cs_pin) {
+  memset(device, 0, sizeof(*device));
+  device->spi_instance = instance;
+  device->spi_cs_port = cs_port;
+  device->spi_cs_pin = cs_pin;
+  SPI_DeviceBusInit(device);
+}
+
+static uint32_t bench_check(const char* name, bool ok) {
+  printf("%-10s %s\n", name, ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
+
+static void bench_stream_block(spi_stream_t* stream, const spi_stream_frame_t* block, uint16_t count, void* context) {
+  UNUSED(stream);
+  UNUSED(block);
+  *(uint32_t*) context += count;
+}
+
+static void bench_ring_CB(void* Handle) {
+  UNUSED(Handle);
+}
+
+static void bench_count_CB(void* Handle) {
+  (*(uint32_t*) Handle)++;
+}
+
+static void bench_async_CB(spi_async_t* transfer, uint8_t status, void* context) {
+  UNUSED(transfer);
+  *(int16_t*) context = status;
+}
+
+static void bench_models_task(void* pvParameters) {
+  spi_device_t device;
+  uint8_t tx[8], rx[8];
+  uint8_t block[1024], readback[1024];
+  uint32_t failed = 0;
+  bool ok;
+  UNUSED(pvParameters);
+
+  // W5500: VERSIONR, then a socket 0 TX buffer block written and read back in one frame each
+  bench_model_device(&device, SPI_MODEL_W5500_SPI, SPI_MODEL_W5500_CS_PORT, SPI_MODEL_W5500_CS_PIN);
+  tx[0] = 0x00; tx[1] = 0x39; tx[2] = 0x00;
+  ok = SPI_Device_WriteThenRead(&device, tx, 3, rx, 1) == HAL_OK && rx[0] == SPI_MODEL_W5500_VERSION;
+  for(uint16_t i = 0; i < sizeof(block); i++) block[i] = (uint8_t) (i * 7);
+  {
+    uint8_t header_w[3] = { 0x01, 0x00, (2 << 3) | 0x04 }, header_r[3] = { 0x01, 0x00, (2 << 3) };
+    spi_iovec_t tx_iov[2] = { { header_w, 3 }, { block, sizeof(block) } };
+    spi_iovec_t hdr_iov = { header_r, 3 }, rx_iov = { readback, sizeof(readback) };
+
+    ok = ok && SPI_Device_WriteV(&device, tx_iov, 2) == HAL_OK
+            && SPI_Device_WriteThenReadV(&device, &hdr_iov, 1, &rx_iov, 1) == HAL_OK
+            && memcmp(block, readback, sizeof(block)) == 0;
+  }
+  failed += bench_check("W5500", ok);
+
+  // W5500 retry: the payload span fails halfway, the retry has to repeat the header with it.
+  // Resent alone the payload's first bytes would be parsed as a header (0x0007, socket 0 register write).
+  {
+    uint8_t header_w[3] = { 0x01, 0x00, (2 << 3) | 0x04 }, header_r[3] = { 0x01, 0x00, (2 << 3) };
+    uint8_t registers[SPI_MODEL_W5500_SOCKET_SIZE];
+    spi_iovec_t tx_iov[2] = { { header_w, 3 }, { block, sizeof(block) } };
+    spi_iovec_t hdr_iov = { header_r, 3 }, rx_iov = { readback, sizeof(readback) };
+    spi_device_stats_t stats;
+
+    memset(bench_board.w5500.tx_buf[0], 0, sizeof(bench_board.w5500.tx_buf[0]));
+    memcpy(registers, bench_board.w5500.socket[0], sizeof(registers));
+    SPI_Stats_Reset(&device.stats);
+
+    // Devices don't retry by default, the failed list is reported
+    HAL_SPI_Host_FailTransfer(SPI_MODEL_W5500_SPI, 1);
+    ok = SPI_Device_WriteV(&device, tx_iov, 2) != HAL_OK;
+
+    // Buffer accesses are retried like in WIZCHIP_READ_BUF()/WIZCHIP_WRITE_BUF()
+    device.retries = 2;
+    HAL_SPI_Host_FailTransfer(SPI_MODEL_W5500_SPI, 1);  // The header goes through, the payload fails
+
+    ok = ok && SPI_Device_WriteV(&device, tx_iov, 2) == HAL_OK
+         && SPI_Device_WriteThenReadV(&device, &hdr_iov, 1, &rx_iov, 1) == HAL_OK
+         && memcmp(block, readback, sizeof(block)) == 0
+         && memcmp(registers, bench_board.w5500.socket[0], sizeof(registers)) == 0;
+    SPI_Stats_Get(&device.stats, &stats);
+    failed += bench_check("W5500 retry", ok && stats.retries == 1);
+  }
+
+  // W5500 driver: w5500.c on the ioLibrary stubs, a socket 0 send and receive moves the buffer pointers
+  {
+    bus_device_t w5500;
+    uint16_t tx_wr, rx_rd;
+
+    memset(&w5500, 0, sizeof(w5500));
+    bench_model_device(&w5500.spi_device_handle, SPI_MODEL_W5500_SPI, SPI_MODEL_W5500_CS_PORT, SPI_MODEL_W5500_CS_PIN);
+    W5500_Ethernet_Init(&w5500);
+    ok = getVERSIONR() == SPI_MODEL_W5500_VERSION;
+
+    tx_wr = getSn_TX_WR(0);
+    wiz_send_data(0, block, 512);
+    ok = ok && getSn_TX_WR(0) == (uint16_t) (tx_wr + 512)
+            && memcmp(&bench_board.w5500.tx_buf[0][tx_wr], block, 512) == 0;
+
+    rx_rd = getSn_RX_RD(0);
+    ok = ok && SPI_Model_W5500_Receive(&bench_board.w5500, 0, block, 256) == 256;
+    wiz_recv_data(0, readback, 256);
+    ok = ok && getSn_RX_RD(0) == (uint16_t) (rx_rd + 256)
+            && memcmp(block, readback, 256) == 0;
+    failed += bench_check("W5500 driver", ok && !w5500.error);
+  }
+
+  // MCP23S08: all outputs, OLAT through the GPIO register, inputs on the upper nibble
+  bench_model_device(&device, SPI_MODEL_MCP23S08_SPI, SPI_MODEL_MCP23S08_CS_PORT, SPI_MODEL_MCP23S08_CS_PIN);
+  tx[0] = 0x40; tx[1] = 0x00; tx[2] = 0xF0;             // IODIR: upper nibble in
+  ok = SPI_DeviceWrite(&device, tx, 3) == HAL_OK;
+  tx[1] = 0x09; tx[2] = 0x05;                           // GPIO -> OLAT
+  ok = ok && SPI_DeviceWrite(&device, tx, 3) == HAL_OK;
+  SPI_Model_MCP23S08_SetInputs(&bench_board.mcp23s08, 0xA0);
+  tx[0] = 0x41;
+  ok = ok && SPI_Device_WriteThenRead(&device, tx, 2, rx, 1) == HAL_OK && rx[0] == 0xA5
+          && SPI_Model_MCP23S08_GetOutputs(&bench_board.mcp23s08) == 0x05;
+  failed += bench_check("MCP23S08", ok);
+
+  // AD7324: select channel 2, the next frame clocks out its conversion
+  bench_model_device(&device, SPI_MODEL_AD7324_SPI, SPI_MODEL_AD7324_CS_PORT, SPI_MODEL_AD7324_CS_PIN);
+  SPI_Model_AD7324_SetInput(&bench_board.ad7324, 2, -1000);
+  tx[0] = 0xA8; tx[1] = 0x00;                           // Control: write, ADD = 2
+  ok = SPI_Device_WriteWhileRead(&device, tx, rx, 2) == HAL_OK;
+  tx[0] = 0x00;
+  ok = ok && SPI_Device_WriteWhileRead(&device, tx, rx, 2) == HAL_OK
+          && ((rx[0] >> 5) & 0x03) == 2 && (uint16_t) (((rx[0] & 0x1F) << 8) | rx[1]) == ((uint16_t) -1000 & 0x1FFF);
+  failed += bench_check("AD7324", ok);
+
+  // AD7324 streaming: sequencer over channels 0..3, ticked 8 times into a ring of 4 frames
+  {
+    spi_stream_frame_t frames[4];
+    spi_stream_t stream;
+    uint32_t handed_off = 0;
+    spi_stream_config_t config = {
+        .frames = frames, .frame_count = 4, .channels = 4, .command = 0x0000,
+        .on_block = bench_stream_block, .context = &handed_off,
+    };
+
+    for(uint8_t ch = 0; ch < 4; ch++) SPI_Model_AD7324_SetInput(&bench_board.ad7324, ch, (int16_t) (100 * ch - 150));
+    tx[0] = 0xAC; tx[1] = 0x08;                         // Control: write, ADD = 3, consecutive sequence
+    ok = SPI_DeviceWrite(&device, tx, 2) == HAL_OK && SPI_Device_StreamStart(&device, &stream, &config) == HAL_OK;
+    for(uint8_t n = 0; ok && n < 8; n++) SPI_Stream_Tick(&stream);
+    SPI_Stream_Stop(&stream);
+
+    ok = ok && stream.scans == 8 && handed_off == 8 && stream.overruns == 0;
+    for(uint8_t f = 0; ok && f < 4; f++) {
+      for(uint8_t ch = 0; ch < 4; ch++) {
+        ok = ok && frames[f].samples[ch] == ((ch << 13) | ((uint16_t) (100 * ch - 150) & 0x1FFF));
+      }
+    }
+    failed += bench_check("AD7324 stream", ok);
+  }
+
+  // Stream settings: the tick reprograms SPI1 from the interrupt, the MCP23S08 configured before it
+  // gets its own settings back once its guard holds the bus
+  {
+    spi_device_t expander;
+    spi_stream_frame_t frames[2];
+    spi_stream_t stream;
+    uint32_t handed_off = 0, stream_rate;
+    spi_stream_config_t config = {
+        .frames = frames, .frame_count = 2, .channels = 1, .command = 0x0000,
+        .on_block = bench_stream_block, .context = &handed_off,
+    };
+
+    bench_model_device(&expander, SPI_MODEL_MCP23S08_SPI, SPI_MODEL_MCP23S08_CS_PORT, SPI_MODEL_MCP23S08_CS_PIN);
+    expander.spi_settings = (spi_settings_t) { .DataSize = SPI_DATASIZE_8BIT, .BaudRatePrescaler = SPI_BAUDRATEPRESCALER_16 };
+    device.spi_settings = (spi_settings_t) { .DataSize = SPI_DATASIZE_8BIT, .BaudRatePrescaler = SPI_BAUDRATEPRESCALER_4 };
+
+    ok = SPI_Device_ConfigSPI(&expander) == HAL_OK && SPI_Device_StreamStart(&device, &stream, &config) == HAL_OK;
+    SPI_Stream_Tick(&stream);
+    SPI_Stream_Stop(&stream);
+    stream_rate = HAL_SPI_Host_GetBitRate(SPI_MODEL_AD7324_SPI);
+
+    tx[0] = 0x41; tx[1] = 0x00;                         // IODIR
+    ok = ok && stream.scans == 1 && stream_rate == HAL_SPI_HOST_PCLK2_HZ / 4
+            && SPI_Device_WriteThenRead(&expander, tx, 2, rx, 1) == HAL_OK && rx[0] == 0xF0
+            && HAL_SPI_Host_GetBitRate(SPI_MODEL_MCP23S08_SPI) == HAL_SPI_HOST_PCLK2_HZ / 16;
+    failed += bench_check("Stream settings", ok);
+  }
+
+  // AD5724: DAC B, read back in the following NOP frame
+  bench_model_device(&device, SPI_MODEL_AD5724_SPI, SPI_MODEL_AD5724_CS_PORT, SPI_MODEL_AD5724_CS_PIN);
+  tx[0] = 0x01; tx[1] = 0xAB; tx[2] = 0xC0;
+  ok = SPI_DeviceWrite(&device, tx, 3) == HAL_OK && SPI_Model_AD5724_GetOutput(&bench_board.ad5724, 1) == 0xABC;
+  tx[0] = 0x81;
+  ok = ok && SPI_DeviceWrite(&device, tx, 3) == HAL_OK;
+  tx[0] = 0x18; tx[1] = 0x00; tx[2] = 0x00;             // Control NOP
+  ok = ok && SPI_Device_WriteWhileRead(&device, tx, rx, 3) == HAL_OK && rx[1] == 0xAB && rx[2] == 0xC0;
+  failed += bench_check("AD5724", ok);
+
+  // MAX31865: bias on, one-shot conversion, RTD registers
+  bench_model_device(&device, SPI_MODEL_MAX31865_SPI, SPI_MODEL_MAX31865_CS_PORT, SPI_MODEL_MAX31865_CS_PIN);
+  SPI_Model_MAX31865_SetRtd(&bench_board.max31865, 0x2000);
+  tx[0] = 0x80; tx[1] = 0xA0;
+  ok = SPI_DeviceWrite(&device, tx, 2) == HAL_OK;
+  tx[0] = 0x01;
+  ok = ok && SPI_Device_WriteThenRead(&device, tx, 1, rx, 2) == HAL_OK && rx[0] == 0x40 && rx[1] == 0x00;
+  failed += bench_check("MAX31865", ok);
+
+  // Async late: the ISR ring of the bus is full when the transfer completes, on_complete still runs
+  {
+    SPI_Executor_t* executor = SPI_Task_GetExecutor(SPI_MODEL_MAX31865_SPI);
+    SPI_Queue_Data_t request = { .SPI_Request_Fp = bench_ring_CB };
+    spi_async_t transfer = { 0 };
+    spi_device_stats_t stats;
+    int16_t status = -1;
+
+    // The SPI Task has a lower priority and can't drain the ring in between
+    SPI_Stats_Reset(&device.stats);
+    for(uint8_t i = 0; i < SPI_ISR_RING_SIZE; i++) {
+      SPI_Executor_Send_Request_fromISR(executor, request, SPI_PRIO_URGENT);
+    }
+    tx[0] = 0x01;
+    ok = SPI_Device_TransferAsync(&device, &transfer, tx, rx, 3, bench_async_CB, &status) == HAL_OK;
+    for(uint16_t ms = 0; ok && SPI_Async_IsPending(&transfer) && ms < 100; ms++) vTaskDelay(1);
+    SPI_Stats_Get(&device.stats, &stats);
+    failed += bench_check("Async late", ok && status == HAL_OK && stats.late == 1 && rx[1] == 0x40);
+  }
+
+  // Async expiry: a hung transfer times out at its deadline through the SPI Task, no other task waits for the bus
+  {
+    spi_async_t transfer = { 0 };
+    spi_device_stats_t stats;
+    int16_t status = -1;
+    uint16_t ms;
+
+    SPI_Stats_Reset(&device.stats);
+    device.timeout_ms = 2;
+    HAL_SPI_Host_StallTransfer(SPI_MODEL_MAX31865_SPI);
+    tx[0] = 0x01;
+    ok = SPI_Device_TransferAsync(&device, &transfer, tx, rx, 3, bench_async_CB, &status) == HAL_OK;
+    for(ms = 0; ok && SPI_Async_IsPending(&transfer) && ms < 100; ms++) vTaskDelay(1);
+    SPI_Stats_Get(&device.stats, &stats);
+    ok = ok && status == HAL_TIMEOUT && stats.timeouts == 1 && ms <= device.timeout_ms + SPI_TASK_EXPIRY_MS + 2;
+
+    // The expiry released the bus
+    ok = ok && SPI_Device_WriteThenRead(&device, tx, 1, rx, 2) == HAL_OK && rx[0] == 0x40;
+    failed += bench_check("Async expiry", ok);
+  }
+
+  // Bulk coalescing: idempotent duplicates queued before the first one starts run once, others all
+  {
+    SPI_Executor_t* executor = SPI_Task_GetExecutor(SPI_MODEL_W5500_SPI);
+    SPI_Executor_Stats_t stats;
+    uint32_t idempotent = 0, plain = 0;
+    SPI_Queue_Data_t request = { .SPI_Request_Fp = bench_count_CB, .Handle = &idempotent,
+                                 .Flags = SPI_REQUEST_FLAG_IDEMPOTENT };
+
+    // The SPI Task has a lower priority, all requests are pending when it starts
+    SPI_Executor_ResetStats(executor);
+    ok = true;
+    for(uint8_t i = 0; i < 4; i++) {
+      ok = ok && SPI_Executor_Send_Request(executor, request, SPI_PRIO_BULK, SPI_BP_FAIL_FAST, 0) == SPI_REQUEST_OK;
+    }
+    request.Handle = &plain;
+    request.Flags = SPI_REQUEST_FLAG_NONE;
+    for(uint8_t i = 0; i < 2; i++) {
+      ok = ok && SPI_Executor_Send_Request(executor, request, SPI_PRIO_BULK, SPI_BP_FAIL_FAST, 0) == SPI_REQUEST_OK;
+    }
+    vTaskDelay(10);
+    SPI_Executor_GetStats(executor, &stats);
+    failed += bench_check("Bulk coalescing", ok && idempotent == 1 && plain == 2 && stats.Coalesced == 3);
+  }
+
+  exit((int) failed);
+}
+
+// Request of the isr mode, executed by the SPI Task
+static void bench_isr_CB(void* Handle) {
+  const bench_isr_args_t* args = (const bench_isr_args_t*) Handle;
+
+  bench_transfer_CB(bench_stress_bus);
+  if(args->seq < bench_isr_next[args->producer][args->priority]) bench_isr_reordered++;
+  bench_isr_next[args->producer][args->priority] = args->seq + 1;
+  bench_isr_executed[args->producer][args->seq]++;
+  bench_isr_executions++;
+}
+
+// One interrupt source, queues bursts of requests alternating between the lanes
+static void bench_isr_producer_task(void* pvParameters) {
+  uint8_t producer = (uint8_t) (uintptr_t) pvParameters;
+
+  for(uint16_t seq = 0; seq < BENCH_ISR_REQUESTS; seq++) {
+    bench_isr_args_t args = { .producer = producer, .priority = (seq & 1) ? SPI_PRIO_BULK : SPI_PRIO_URGENT, .seq = seq };
+    SPI_Queue_Data_t request = { .SPI_Request_Fp = bench_isr_CB };
+    SPI_Request_Status_t status;
+
+    SPI_Queue_Data_SetArgs(&request, &args, sizeof(args));
+
+    // The producers of the higher priority preempt the others like a higher NVIC priority would
+    status = SPI_Executor_Send_Request_fromISR(bench_stress_bus->executor, request, (SPI_Request_Priority_t) args.priority);
+    bench_isr_accepted[producer][seq] = (status == SPI_REQUEST_OK);
+
+    if((seq + 1) % BENCH_ISR_BURST == 0) vTaskDelay(1);
+  }
+
+  taskENTER_CRITICAL();
+  bench_isr_producers_done++;
+  taskEXIT_CRITICAL();
+  vTaskDelete(NULL);
+}
+
+static uint32_t bench_isr_drops(SPI_Executor_t* executor) {
+  return SPI_Executor_GetDropCount(executor, SPI_PRIO_URGENT) + SPI_Executor_GetDropCount(executor, SPI_PRIO_BULK);
+}
+
+static void bench_isr_task(void* pvParameters) {
+  const uint32_t produced = BENCH_ISR_PRODUCERS * BENCH_ISR_REQUESTS;
+  SPI_Executor_Stats_t stats;
+  uint32_t drops_start, drops, waited = 0;
+  uint32_t duplicates = 0, rejected = 0, rejected_executed = 0, unexecuted = 0, urgent_lost = 0;
+  uint32_t failed = 0;
+  UNUSED(pvParameters);
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT && bench_stress_bus == NULL; spi_idx++) {
+    if(bench_buses[spi_idx].executor != NULL) bench_stress_bus = &bench_buses[spi_idx];
+  }
+  if(bench_stress_bus == NULL) {
+    fprintf(stderr, "no executor configured\n");
+    exit(1);
+  }
+
+  SPI_Executor_ResetStats(bench_stress_bus->executor);
+  drops_start = bench_isr_drops(bench_stress_bus->executor);
+
+  for(uint8_t producer = 0; producer < BENCH_ISR_PRODUCERS; producer++) {
+    xTaskCreate(bench_isr_producer_task, "SPI_Bench_ISR", configMINIMAL_STACK_SIZE * 2,
+                (void*) (uintptr_t) producer, BENCH_TASK_PRIORITY + 1 + (producer & 1), NULL);
+  }
+
+  // Every request is either executed or counted as dropped
+  do {
+    vTaskDelay(1);
+    drops = bench_isr_drops(bench_stress_bus->executor) - drops_start;
+  } while((bench_isr_producers_done < BENCH_ISR_PRODUCERS || bench_isr_executions + drops < produced)
+          && ++waited < BENCH_ISR_DRAIN_MS);
+
+  for(uint8_t producer = 0; producer < BENCH_ISR_PRODUCERS; producer++) {
+    for(uint16_t seq = 0; seq < BENCH_ISR_REQUESTS; seq++) {
+      uint8_t executed = bench_isr_executed[producer][seq];
+
+      if(executed > 1) duplicates++;
+      if(!bench_isr_accepted[producer][seq]) {
+        rejected++;
+        if(executed != 0) rejected_executed++;
+      }
+      else if(executed == 0) {
+        unexecuted++;
+        // Only the bulk lane can shed a request taken from the ring
+        if(!(seq & 1)) urgent_lost++;
+      }
+    }
+  }
+
+  SPI_Executor_GetStats(bench_stress_bus->executor, &stats);
+  printf("produced %lu, executed %lu, rejected %lu, dropped from lane %lu, counted drops %lu, ring high water %lu\n",
+         (unsigned long) produced, (unsigned long) bench_isr_executions, (unsigned long) rejected,
+         (unsigned long) unexecuted, (unsigned long) drops, (unsigned long) stats.IsrRingHighWater);
+
+  failed += bench_check("ISR drained", bench_isr_producers_done == BENCH_ISR_PRODUCERS && bench_isr_executions + drops == produced);
+  failed += bench_check("ISR duplicates", duplicates == 0);
+  failed += bench_check("ISR lost", rejected_executed == 0 && urgent_lost == 0 && drops == rejected + unexecuted);
+  failed += bench_check("ISR order", bench_isr_reordered == 0);
+  failed += bench_check("ISR overflow", rejected != 0 && stats.IsrRingHighWater == SPI_ISR_RING_SIZE);
+
+  exit((int) failed);
+}
+
+// Urgent request of the urgent mode, the inline argument is its enqueue time
+static void bench_urgent_CB(void* Handle) {
+  uint64_t wait = bench_now_ns() - *(const uint64_t*) Handle;
+  uint8_t command[4] = { 0 };
+  spi_segment_t segment = { .tx = command, .len = sizeof(command) };
+
+  if(wait > bench_urgent_max_wait_ns) bench_urgent_max_wait_ns = wait;
+  SPI_Device_Transfer(&bench_stress_bus->device, &segment, 1);
+  bench_urgent_done++;
+}
+
+static void bench_urgent_task(void* pvParameters) {
+  bench_bus_t* bus = NULL;
+  uint32_t queued = 0, min_backlog = UINT32_MAX, waited = 0;
+  uint64_t bulk_ns;
+  uint32_t failed = 0;
+  UNUSED(pvParameters);
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT && bus == NULL; spi_idx++) {
+    if(bench_buses[spi_idx].executor != NULL) bus = &bench_buses[spi_idx];
+  }
+  if(bus == NULL) {
+    fprintf(stderr, "no executor configured\n");
+    exit(1);
+  }
+  bench_stress_bus = bus;
+  // An urgent request waits for the bulk request in progress at most
+  bulk_ns = (uint64_t) bench_transfer_size * 8U * 1000000000ULL / HAL_SPI_Host_GetBitRate(bus->device.spi_instance);
+
+  for(uint32_t n = 0; n < BENCH_URGENT_REQUESTS; n++) {
+    uint64_t enqueued;
+
+    // Flood the bulk lane, the urgent request must overtake all of it
+    while(queued - bus->done < BENCH_URGENT_BACKLOG) {
+      if(SPI_Executor_QueueRequest(bus->executor, bench_transfer_CB, bus, SPI_PRIO_BULK) == SPI_REQUEST_OK) queued++;
+    }
+    if(queued - bus->done < min_backlog) min_backlog = queued - bus->done;
+
+    enqueued = bench_now_ns();
+    while(SPI_Executor_QueueRequestArgs(bus->executor, bench_urgent_CB, &enqueued, sizeof(enqueued), SPI_PRIO_URGENT) != SPI_REQUEST_OK);
+    vTaskDelay(1);
+  }
+
+  while((bench_urgent_done < BENCH_URGENT_REQUESTS || bus->done < queued) && ++waited < BENCH_ISR_DRAIN_MS) vTaskDelay(1);
+
+  printf("urgent max wait %.1f us, bulk transfer %.1f us, backlog ahead >= %lu (%.1f us FIFO)\n",
+         bench_urgent_max_wait_ns / 1e3, bulk_ns / 1e3, (unsigned long) min_backlog, min_backlog * (bulk_ns / 1e3));
+
+  failed += bench_check("Urgent drained", bench_urgent_done == BENCH_URGENT_REQUESTS && bus->done == queued);
+  failed += bench_check("Urgent flood", min_backlog > 1);
+  failed += bench_check("Urgent wait", bench_urgent_max_wait_ns <= bulk_ns + BENCH_URGENT_MARGIN_US * 1000ULL);
+
+  exit((int) failed);
+}
+
+static void bench_task(void* pvParameters) {
+  uint64_t start, elapsed;
+  bool pending;
+  UNUSED(pvParameters);
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    if(bench_buses[spi_idx].executor == NULL) continue;
+    SPI_Executor_ResetStats(bench_buses[spi_idx].executor);
+    SPI_Stats_Reset(&bench_buses[spi_idx].device.stats);
+    HAL_SPI_Host_ResetStats(bench_instances[spi_idx]);
+  }
+
+  start = bench_now_ns();
+
+  // Interleave the buses so they are loaded at the same time
+  for(uint32_t n = 0; n < bench_requests; n++) {
+    for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+      bench_bus_t* bus = &bench_buses[spi_idx];
+
+      if(bus->executor == NULL) continue;
+      while(SPI_Executor_QueueRequest(bus->executor, bench_transfer_CB, bus, SPI_PRIO_BULK) != SPI_REQUEST_OK);
+    }
+  }
+
+  do {
+    vTaskDelay(1);
+    pending = false;
+    for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+      if(bench_buses[spi_idx].executor != NULL && bench_buses[spi_idx].done < bench_requests) pending = true;
+    }
+  } while(pending);
+
+  elapsed = bench_now_ns() - start;
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    if(bench_buses[spi_idx].executor != NULL) bench_report(spi_idx, elapsed);
+  }
+
+  exit(0);
+}
+
+int main(int argc, char** argv)
+{
+  TaskFunction_t bench = bench_task;
+
+  if(argc > 1 && strcmp(argv[1], "models") == 0) {
+    bench = bench_models_task;
+  }
+  else if(argc > 1 && strcmp(argv[1], "isr") == 0) {
+    bench = bench_isr_task;
+  }
+  else if(argc > 1 && strcmp(argv[1], "urgent") == 0) {
+    bench = bench_urgent_task;
+    bench_transfer_size = (argc > 2) ? (uint16_t) strtoul(argv[2], NULL, 0) : BENCH_URGENT_SIZE;
+    if(argc > 3) bench_bit_rate = strtoul(argv[3], NULL, 0);
+  }
+  else if(argc > 1 && strcmp(argv[1], "threshold") == 0) {
+    bench = bench_threshold_task;
+    bench_requests = 1000;
+    if(argc > 2) bench_bit_rate = strtoul(argv[2], NULL, 0);
+  }
+  else {
+    if(argc > 1) bench_requests = strtoul(argv[1], NULL, 0);
+    if(argc > 2) bench_transfer_size = (uint16_t) strtoul(argv[2], NULL, 0);
+    if(argc > 3) bench_bit_rate = strtoul(argv[3], NULL, 0);
+  }
+  if(bench_transfer_size == 0 || bench_transfer_size > BENCH_MAX_TRANSFER) bench_transfer_size = BENCH_TRANSFER_SIZE;
+
+  HAL_SPI_Host_Init();
+  if(bench == bench_models_task && !SPI_Models_AttachBoard(&bench_board)) {
+    fprintf(stderr, "device models don't fit on the buses\n");
+    return 1;
+  }
+  SPI_Task_Init();
+
+  for(uint8_t spi_idx = 0; spi_idx < SPI_BUS_COUNT; spi_idx++) {
+    bench_bus_t* bus = &bench_buses[spi_idx];
+
+    bus->executor = SPI_Task_GetExecutor(bench_instances[spi_idx]);
+    if(bus->executor == NULL) continue;
+
+    bus->device.spi_instance = bench_instances[spi_idx];
+    bus->device.spi_cs_port = GPIOA;
+    bus->device.spi_cs_pin = GPIO_PIN_4;
+    SPI_DeviceBusInit(&bus->device);
+    HAL_SPI_Host_SetBitRate(bench_instances[spi_idx], bench_bit_rate);
+  }
+
+  xTaskCreate(bench, "SPI_Bench", configMINIMAL_STACK_SIZE * 4, NULL, BENCH_TASK_PRIORITY, NULL);
+  vTaskStartScheduler();
+
+  return 0;
+}
@@ -0,0 +1,704 @@
+/*
+ * spi_models_host.c
+ *
+ *  Device models of the board for the host SPI bus, see spi_models_host.h
+ */
+
+#include "spi_models_host.h"
+
+#include <string.h>
+
+// W5500 (WIZnet W5500 datasheet 2.x)
+#define W5500_CTRL_BSB_Pos        3
+#define W5500_CTRL_RWB            0x04
+#define W5500_BLOCK_COMMON        0
+#define W5500_BLOCK_SOCKET        1
+#define W5500_BLOCK_TX            2
+#define W5500_BLOCK_RX            3
+
+#define W5500_MR                  0x00
+#define W5500_MR_RST              0x80
+#define W5500_PHYCFGR             0x2E
+#define W5500_PHYCFGR_RESET       0xBF // Link up, 100 Mbit/s, full duplex
+#define W5500_VERSIONR            0x39
+
+#define W5500_Sn_MR               0x00
+#define W5500_Sn_CR               0x01
+#define W5500_Sn_IR               0x02
+#define W5500_Sn_SR               0x03
+#define W5500_Sn_RXBUF_SIZE       0x1E
+#define W5500_Sn_TXBUF_SIZE       0x1F
+#define W5500_Sn_TX_FSR           0x20
+#define W5500_Sn_TX_RD            0x22
+#define W5500_Sn_TX_WR            0x24
+#define W5500_Sn_RX_RSR           0x26
+#define W5500_Sn_RX_RD            0x28
+#define W5500_Sn_RX_WR            0x2A
+
+#define W5500_Sn_CR_OPEN          0x01
+#define W5500_Sn_CR_LISTEN        0x02
+#define W5500_Sn_CR_CONNECT       0x04
+#define W5500_Sn_CR_DISCON        0x08
+#define W5500_Sn_CR_CLOSE         0x10
+#define W5500_Sn_CR_SEND          0x20
+#define W5500_Sn_CR_SEND_MAC      0x21
+#define W5500_Sn_CR_SEND_KEEP     0x22
+
+#define W5500_Sn_IR_CON           0x01
+#define W5500_Sn_IR_DISCON        0x02
+#define W5500_Sn_IR_RECV          0x04
+#define W5500_Sn_IR_SENDOK        0x10
+
+#define W5500_SOCK_CLOSED         0x00
+#define W5500_SOCK_INIT           0x13
+#define W5500_SOCK_LISTEN         0x14
+#define W5500_SOCK_ESTABLISHED    0x17
+#define W5500_SOCK_UDP            0x22
+#define W5500_SOCK_MACRAW         0x42
+
+// MCP23S08
+#define MCP23S08_OPCODE           0x40
+#define MCP23S08_OPCODE_MASK      0xF8
+#define MCP23S08_OPCODE_READ      0x01
+#define MCP23S08_IODIR            0x00
+#define MCP23S08_IPOL             0x01
+#define MCP23S08_IOCON            0x05
+#define MCP23S08_IOCON_SEQOP      0x20
+#define MCP23S08_IOCON_HAEN       0x08
+#define MCP23S08_INTF             0x07
+#define MCP23S08_INTCAP           0x08
+#define MCP23S08_GPIO             0x09
+#define MCP23S08_OLAT             0x0A
+
+// AD7324
+#define AD7324_WRITE              0x8000
+#define AD7324_REG_Pos            13
+#define AD7324_REG_CONTROL        1
+#define AD7324_REG_RANGE          2
+#define AD7324_REG_SEQUENCE       3
+#define AD7324_CTRL_ADD_Pos       10
+#define AD7324_CTRL_CODING        0x0020 // 1: straight binary
+#define AD7324_CTRL_SEQ_Pos       2
+#define AD7324_SEQ_OFF            0
+#define AD7324_SEQ_PROGRAMMED     1      // Channels of the sequence register
+#define AD7324_SEQ_CONSECUTIVE    2      // Channel 0 up to ADD
+#define AD7324_SEQ_VIN0_Pos       12     // Sequence register: VIN0 at bit 12, VIN3 at bit 9
+#define AD7324_OUT_ADD_Pos        13
+#define AD7324_CODE_MASK          0x1FFF
+
+// AD5724
+#define AD5724_READ               0x80
+#define AD5724_REG_Pos            3
+#define AD5724_REG_DAC            0
+#define AD5724_REG_RANGE          1
+#define AD5724_REG_POWER          2
+#define AD5724_REG_CONTROL        3
+#define AD5724_ADDR_ALL           4
+#define AD5724_CTRL_CLEAR         4
+#define AD5724_DATA_Pos           4      // 12 bit codes are left aligned
+
+// MAX31865
+#define MAX31865_WRITE            0x80
+#define MAX31865_CONFIG           0x00
+#define MAX31865_RTD_MSB          0x01
+#define MAX31865_RTD_LSB          0x02
+#define MAX31865_HFT_MSB          0x03
+#define MAX31865_LFT_MSB          0x05
+#define MAX31865_LFT_LSB          0x06
+#define MAX31865_FAULT            0x07
+#define MAX31865_CFG_VBIAS        0x80
+#define MAX31865_CFG_AUTO         0x40
+#define MAX31865_CFG_ONESHOT      0x20
+#define MAX31865_CFG_FAULT_CLEAR  0x02
+#define MAX31865_FAULT_HIGH       0x80
+#define MAX31865_FAULT_LOW        0x40
+
+// Helper Functions
+static inline uint16_t get_be16(const uint8_t* p) {
+  return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+static inline void put_be16(uint8_t* p, uint16_t value) {
+  p[0] = (uint8_t) (value >> 8);
+  p[1] = (uint8_t) value;
+}
+
+// W5500
+static uint16_t w5500_buf_size(const uint8_t* socket, uint8_t size_reg) {
+  uint8_t kib = socket[size_reg];
+
+  return (kib > 16) ? 0 : (uint16_t) (kib * 1024U);
+}
+
+// Buffer sizes are powers of two, the pointers wrap inside them
+static uint8_t* w5500_buf(spi_model_w5500_t* dev, uint8_t sn, bool rx, uint16_t address) {
+  uint16_t size = w5500_buf_size(dev->socket[sn], rx ? W5500_Sn_RXBUF_SIZE : W5500_Sn_TXBUF_SIZE);
+
+  if(size == 0) return NULL;
+  return rx ? &dev->rx_buf[sn][address & (size - 1)] : &dev->tx_buf[sn][address & (size - 1)];
+}
+
+static void w5500_socket_reset(spi_model_w5500_t* dev, uint8_t sn) {
+  memset(dev->socket[sn], 0, SPI_MODEL_W5500_SOCKET_SIZE);
+  dev->socket[sn][W5500_Sn_RXBUF_SIZE] = 2;
+  dev->socket[sn][W5500_Sn_TXBUF_SIZE] = 2;
+}
+
+static void w5500_reset(spi_model_w5500_t* dev) {
+  memset(dev->common, 0, sizeof(dev->common));
+  dev->common[W5500_PHYCFGR] = W5500_PHYCFGR_RESET;
+  dev->common[W5500_VERSIONR] = SPI_MODEL_W5500_VERSION;
+
+  for(uint8_t sn = 0; sn < SPI_MODEL_W5500_SOCKETS; sn++) {
+    w5500_socket_reset(dev, sn);
+  }
+}
+
+// Commands are executed at once, Sn_CR reads back 0
+static void w5500_command(spi_model_w5500_t* dev, uint8_t sn, uint8_t command) {
+  uint8_t* socket = dev->socket[sn];
+  uint16_t pending;
+
+  switch(command) {
+  case W5500_Sn_CR_OPEN:
+    switch(socket[W5500_Sn_MR] & 0x0F) {
+    case 1:  socket[W5500_Sn_SR] = W5500_SOCK_INIT; break;
+    case 2:  socket[W5500_Sn_SR] = W5500_SOCK_UDP; break;
+    case 4:  socket[W5500_Sn_SR] = (sn == 0) ? W5500_SOCK_MACRAW : W5500_SOCK_CLOSED; break;
+    default: socket[W5500_Sn_SR] = W5500_SOCK_CLOSED; break;
+    }
+    put_be16(&socket[W5500_Sn_TX_RD], 0);
+    put_be16(&socket[W5500_Sn_TX_WR], 0);
+    put_be16(&socket[W5500_Sn_RX_RD], 0);
+    put_be16(&socket[W5500_Sn_RX_WR], 0);
+    break;
+  case W5500_Sn_CR_LISTEN:
+    if(socket[W5500_Sn_SR] == W5500_SOCK_INIT) socket[W5500_Sn_SR] = W5500_SOCK_LISTEN;
+    break;
+  case W5500_Sn_CR_CONNECT:
+    if(socket[W5500_Sn_SR] == W5500_SOCK_INIT) {
+      socket[W5500_Sn_SR] = W5500_SOCK_ESTABLISHED;
+      socket[W5500_Sn_IR] |= W5500_Sn_IR_CON;
+    }
+    break;
+  case W5500_Sn_CR_DISCON:
+    socket[W5500_Sn_SR] = W5500_SOCK_CLOSED;
+    socket[W5500_Sn_IR] |= W5500_Sn_IR_DISCON;
+    break;
+  case W5500_Sn_CR_CLOSE:
+    socket[W5500_Sn_SR] = W5500_SOCK_CLOSED;
+    break;
+  case W5500_Sn_CR_SEND:
+  case W5500_Sn_CR_SEND_MAC:
+  case W5500_Sn_CR_SEND_KEEP:
+    // Everything between TX_RD and TX_WR goes out on the wire at once
+    pending = (uint16_t) (get_be16(&socket[W5500_Sn_TX_WR]) - get_be16(&socket[W5500_Sn_TX_RD]));
+    dev->sent[sn] += pending;
+    put_be16(&socket[W5500_Sn_TX_RD], get_be16(&socket[W5500_Sn_TX_WR]));
+    socket[W5500_Sn_IR] |= W5500_Sn_IR_SENDOK;
+    break;
+  default:
+    // RECV: Sn_RX_RSR is kept up to date continuously
+    break;
+  }
+}
+
+static uint8_t w5500_read(spi_model_w5500_t* dev, uint8_t block, uint16_t address) {
+  uint8_t sn = block >> 2;
+  uint8_t* socket;
+  uint8_t* buf;
+  uint8_t value[2];
+
+  if(sn >= SPI_MODEL_W5500_SOCKETS) return 0;
+
+  switch(block & 0x03) {
+  case W5500_BLOCK_COMMON:
+    if(block != 0) return 0; // Reserved blocks
+    return (address < SPI_MODEL_W5500_COMMON_SIZE) ? dev->common[address] : 0;
+  case W5500_BLOCK_SOCKET:
+    if(address >= SPI_MODEL_W5500_SOCKET_SIZE) return 0;
+    socket = dev->socket[sn];
+
+    // Derived sizes
+    if(address == W5500_Sn_TX_FSR || address == W5500_Sn_TX_FSR + 1) {
+      put_be16(value, (uint16_t) (w5500_buf_size(socket, W5500_Sn_TXBUF_SIZE)
+                                  - (uint16_t) (get_be16(&socket[W5500_Sn_TX_WR]) - get_be16(&socket[W5500_Sn_TX_RD]))));
+      return value[address - W5500_Sn_TX_FSR];
+    }
+    if(address == W5500_Sn_RX_RSR || address == W5500_Sn_RX_RSR + 1) {
+      put_be16(value, (uint16_t) (get_be16(&socket[W5500_Sn_RX_WR]) - get_be16(&socket[W5500_Sn_RX_RD])));
+      return value[address - W5500_Sn_RX_RSR];
+    }
+    return socket[address];
+  case W5500_BLOCK_TX:
+  case W5500_BLOCK_RX:
+    buf = w5500_buf(dev, sn, (block & 0x03) == W5500_BLOCK_RX, address);
+    return (buf != NULL) ? *buf : 0;
+  }
+  return 0;
+}
+
+static void w5500_write(spi_model_w5500_t* dev, uint8_t block, uint16_t address, uint8_t value) {
+  uint8_t sn = block >> 2;
+  uint8_t* buf;
+
+  if(sn >= SPI_MODEL_W5500_SOCKETS) return;
+
+  switch(block & 0x03) {
+  case W5500_BLOCK_COMMON:
+    if(block != 0 || address >= SPI_MODEL_W5500_COMMON_SIZE || address == W5500_VERSIONR) return;
+    if(address == W5500_MR && (value & W5500_MR_RST)) {
+      w5500_reset(dev);
+      return;
+    }
+    dev->common[address] = value;
+    break;
+  case W5500_BLOCK_SOCKET:
+    switch(address) {
+    case W5500_Sn_CR:
+      w5500_command(dev, sn, value);
+      break;
+    case W5500_Sn_IR:
+      dev->socket[sn][W5500_Sn_IR] &= (uint8_t) ~value; // Write 1 to clear
+      break;
+    // Read only
+    case W5500_Sn_SR:
+    case W5500_Sn_TX_FSR: case W5500_Sn_TX_FSR + 1:
+    case W5500_Sn_TX_RD:  case W5500_Sn_TX_RD + 1:
+    case W5500_Sn_RX_RSR: case W5500_Sn_RX_RSR + 1:
+    case W5500_Sn_RX_WR:  case W5500_Sn_RX_WR + 1:
+      break;
+    default:
+      if(address < SPI_MODEL_W5500_SOCKET_SIZE) dev->socket[sn][address] = value;
+      break;
+    }
+    break;
+  case W5500_BLOCK_TX:
+  case W5500_BLOCK_RX:
+    buf = w5500_buf(dev, sn, (block & 0x03) == W5500_BLOCK_RX, address);
+    if(buf != NULL) *buf = value;
+    break;
+  }
+}
+
+static void w5500_select(HAL_SPI_Host_Model_t* model) {
+  ((spi_model_w5500_t*) model)->index = 0;
+}
+
+// Header bytes: address high, address low, control. The device answers 0x01, 0x02, 0x03 meanwhile
+static uint8_t w5500_exchange(HAL_SPI_Host_Model_t* model, uint8_t mosi) {
+  spi_model_w5500_t* dev = (spi_model_w5500_t*) model;
+  uint8_t block = dev->control >> W5500_CTRL_BSB_Pos;
+  uint8_t miso = 0;
+
+  switch(dev->index) {
+  case 0:
+    dev->address = (uint16_t) (mosi << 8);
+    miso = 0x01;
+    break;
+  case 1:
+    dev->address |= mosi;
+    miso = 0x02;
+    break;
+  case 2:
+    dev->control = mosi;
+    miso = 0x03;
+    break;
+  default:
+    // Variable length data mode, the address auto-increments
+    if(dev->control & W5500_CTRL_RWB) {
+      w5500_write(dev, block, dev->address, mosi);
+    }
+    else {
+      miso = w5500_read(dev, block, dev->address);
+    }
+    dev->address++;
+    break;
+  }
+
+  dev->index++;
+  return miso;
+}
+
+void SPI_Model_W5500_Init(spi_model_w5500_t* dev)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->model.Name = "W5500";
+  dev->model.Select = w5500_select;
+  dev->model.Exchange = w5500_exchange;
+  w5500_reset(dev);
+}
+
+uint16_t SPI_Model_W5500_Receive(spi_model_w5500_t* dev, uint8_t sn, const uint8_t* data, uint16_t len)
+{
+  uint8_t* socket;
+  uint16_t size, used, rx_wr;
+
+  if(sn >= SPI_MODEL_W5500_SOCKETS) return 0;
+
+  socket = dev->socket[sn];
+  size = w5500_buf_size(socket, W5500_Sn_RXBUF_SIZE);
+  used = (uint16_t) (get_be16(&socket[W5500_Sn_RX_WR]) - get_be16(&socket[W5500_Sn_RX_RD]));
+  rx_wr = get_be16(&socket[W5500_Sn_RX_WR]);
+
+  if(len > size - used) len = size - used;
+
+  for(uint16_t i = 0; i < len; i++) {
+    *w5500_buf(dev, sn, true, rx_wr++) = data[i];
+  }
+
+  put_be16(&socket[W5500_Sn_RX_WR], rx_wr);
+  if(len > 0) socket[W5500_Sn_IR] |= W5500_Sn_IR_RECV;
+  return len;
+}
+
+// MCP23S08
+static uint8_t mcp23s08_read(spi_model_mcp23s08_t* dev, uint8_t reg) {
+  uint8_t iodir = dev->regs[MCP23S08_IODIR];
+  uint8_t levels = (uint8_t) ((dev->regs[MCP23S08_OLAT] & ~iodir) | (dev->inputs & iodir));
+
+  if(reg == MCP23S08_GPIO) {
+    dev->regs[MCP23S08_INTF] = 0;
+    return levels ^ (dev->regs[MCP23S08_IPOL] & iodir);
+  }
+  return dev->regs[reg];
+}
+
+static void mcp23s08_write(spi_model_mcp23s08_t* dev, uint8_t reg, uint8_t value) {
+  switch(reg) {
+  case MCP23S08_INTF:
+  case MCP23S08_INTCAP:
+    break; // Read only
+  case MCP23S08_GPIO:
+    dev->regs[MCP23S08_OLAT] = value;
+    break;
+  default:
+    dev->regs[reg] = value;
+    break;
+  }
+}
+
+static void mcp23s08_select(HAL_SPI_Host_Model_t* model) {
+  ((spi_model_mcp23s08_t*) model)->index = 0;
+}
+
+static uint8_t mcp23s08_exchange(HAL_SPI_Host_Model_t* model, uint8_t mosi) {
+  spi_model_mcp23s08_t* dev = (spi_model_mcp23s08_t*) model;
+  bool haen = (dev->regs[MCP23S08_IOCON] & MCP23S08_IOCON_HAEN) != 0;
+  uint8_t miso = 0xFF;
+
+  if(dev->index == 0) {
+    dev->opcode = mosi;
+  }
+  else if((dev->opcode & MCP23S08_OPCODE_MASK) != MCP23S08_OPCODE
+          || (haen && ((dev->opcode >> 1) & 0x03) != dev->hw_address)) {
+    // Addressed to another device, SO stays high impedance
+  }
+  else if(dev->index == 1) {
+    dev->reg = mosi;
+  }
+  else {
+    if(dev->reg < SPI_MODEL_MCP23S08_REGS) {
+      if(dev->opcode & MCP23S08_OPCODE_READ) miso = mcp23s08_read(dev, dev->reg);
+      else mcp23s08_write(dev, dev->reg, mosi);
+    }
+    if((dev->regs[MCP23S08_IOCON] & MCP23S08_IOCON_SEQOP) == 0) {
+      dev->reg = (uint8_t) ((dev->reg + 1) % SPI_MODEL_MCP23S08_REGS);
+    }
+  }
+
+  dev->index++;
+  return miso;
+}
+
+void SPI_Model_MCP23S08_Init(spi_model_mcp23s08_t* dev, uint8_t hw_address)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->model.Name = "MCP23S08";
+  dev->model.Select = mcp23s08_select;
+  dev->model.Exchange = mcp23s08_exchange;
+  dev->hw_address = hw_address & 0x03;
+  dev->regs[MCP23S08_IODIR] = 0xFF;
+}
+
+void SPI_Model_MCP23S08_SetInputs(spi_model_mcp23s08_t* dev, uint8_t pins)
+{
+  dev->inputs = pins;
+}
+
+uint8_t SPI_Model_MCP23S08_GetOutputs(const spi_model_mcp23s08_t* dev)
+{
+  return dev->regs[MCP23S08_OLAT] & (uint8_t) ~dev->regs[MCP23S08_IODIR];
+}
+
+// AD7324
+static uint8_t ad7324_next_channel(const spi_model_ad7324_t* dev) {
+  uint8_t add = (dev->control >> AD7324_CTRL_ADD_Pos) & 0x03;
+
+  switch((dev->control >> AD7324_CTRL_SEQ_Pos) & 0x03) {
+  case AD7324_SEQ_PROGRAMMED:
+    for(uint8_t n = 1; n <= SPI_MODEL_AD7324_CHANNELS; n++) {
+      uint8_t channel = (dev->channel + n) % SPI_MODEL_AD7324_CHANNELS;
+
+      if(dev->sequence & (1U << (AD7324_SEQ_VIN0_Pos - channel))) return channel;
+    }
+    return dev->channel;
+  case AD7324_SEQ_CONSECUTIVE:
+    return (dev->channel >= add) ? 0 : dev->channel + 1;
+  default:
+    return add;
+  }
+}
+
+// Output word: leading zero, channel address, sign and 12 bit result
+static uint16_t ad7324_convert(spi_model_ad7324_t* dev) {
+  int16_t code = dev->inputs[dev->channel];
+  uint16_t result;
+
+  if(dev->control & AD7324_CTRL_CODING) result = (uint16_t) (code + 4096) & AD7324_CODE_MASK;
+  else result = (uint16_t) code & AD7324_CODE_MASK;
+
+  dev->conversions++;
+  return (uint16_t) ((dev->channel << AD7324_OUT_ADD_Pos) | result);
+}
+
+static void ad7324_select(HAL_SPI_Host_Model_t* model) {
+  spi_model_ad7324_t* dev = (spi_model_ad7324_t*) model;
+
+  // The CS falling edge starts the conversion of the channel set up before
+  dev->index = 0;
+  dev->in = 0;
+  dev->out = ad7324_convert(dev);
+  dev->channel = ad7324_next_channel(dev);
+}
+
+static uint8_t ad7324_exchange(HAL_SPI_Host_Model_t* model, uint8_t mosi) {
+  spi_model_ad7324_t* dev = (spi_model_ad7324_t*) model;
+  uint8_t miso = 0;
+
+  if(dev->index < 2) {
+    dev->in = (uint16_t) ((dev->in << 8) | mosi);
+    miso = (uint8_t) (dev->out >> (8 * (1 - dev->index)));
+  }
+
+  dev->index++;
+  return miso;
+}
+
+static void ad7324_deselect(HAL_SPI_Host_Model_t* model) {
+  spi_model_ad7324_t* dev = (spi_model_ad7324_t*) model;
+
+  // Writes take effect with a complete frame
+  if(dev->index < 2 || (dev->in & AD7324_WRITE) == 0) return;
+
+  switch((dev->in >> AD7324_REG_Pos) & 0x03) {
+  case AD7324_REG_CONTROL:
+    dev->control = dev->in & AD7324_CODE_MASK;
+    dev->channel = (dev->control >> AD7324_CTRL_ADD_Pos) & 0x03;
+    if(((dev->control >> AD7324_CTRL_SEQ_Pos) & 0x03) == AD7324_SEQ_CONSECUTIVE) dev->channel = 0;
+    break;
+  case AD7324_REG_RANGE:
+    dev->range = dev->in & AD7324_CODE_MASK;
+    break;
+  case AD7324_REG_SEQUENCE:
+    dev->sequence = dev->in & AD7324_CODE_MASK;
+    break;
+  }
+}
+
+void SPI_Model_AD7324_Init(spi_model_ad7324_t* dev)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->model.Name = "AD7324";
+  dev->model.Select = ad7324_select;
+  dev->model.Exchange = ad7324_exchange;
+  dev->model.Deselect = ad7324_deselect;
+}
+
+void SPI_Model_AD7324_SetInput(spi_model_ad7324_t* dev, uint8_t channel, int16_t code)
+{
+  if(channel < SPI_MODEL_AD7324_CHANNELS) dev->inputs[channel] = code;
+}
+
+// AD5724
+static uint16_t ad5724_register(const spi_model_ad5724_t* dev, uint8_t reg, uint8_t addr) {
+  uint8_t channel = addr % SPI_MODEL_AD5724_CHANNELS;
+
+  switch(reg) {
+  case AD5724_REG_DAC:   return (uint16_t) (dev->dac[channel] << AD5724_DATA_Pos);
+  case AD5724_REG_RANGE: return dev->range[channel];
+  case AD5724_REG_POWER: return dev->power;
+  default:               return dev->control;
+  }
+}
+
+static void ad5724_write(spi_model_ad5724_t* dev, uint8_t reg, uint8_t addr, uint16_t data) {
+  for(uint8_t channel = 0; channel < SPI_MODEL_AD5724_CHANNELS; channel++) {
+    if(addr != AD5724_ADDR_ALL && addr != channel) continue;
+
+    if(reg == AD5724_REG_DAC) dev->dac[channel] = data >> AD5724_DATA_Pos;
+    else if(reg == AD5724_REG_RANGE) dev->range[channel] = data & 0x07;
+  }
+
+  if(reg == AD5724_REG_POWER) {
+    dev->power = data;
+  }
+  else if(reg == AD5724_REG_CONTROL) {
+    if(addr == AD5724_CTRL_CLEAR) memset(dev->dac, 0, sizeof(dev->dac));
+    else if(addr != 0) dev->control = data & 0x0F; // 0: NOP, LOAD has no effect with LDAC low
+  }
+}
+
+static void ad5724_select(HAL_SPI_Host_Model_t* model) {
+  ((spi_model_ad5724_t*) model)->index = 0;
+}
+
+static uint8_t ad5724_exchange(HAL_SPI_Host_Model_t* model, uint8_t mosi) {
+  spi_model_ad5724_t* dev = (spi_model_ad5724_t*) model;
+  uint8_t miso = 0;
+
+  if(dev->index < sizeof(dev->in)) {
+    dev->in[dev->index] = mosi;
+    miso = dev->out[dev->index];
+  }
+
+  dev->index++;
+  return miso;
+}
+
+static void ad5724_deselect(HAL_SPI_Host_Model_t* model) {
+  spi_model_ad5724_t* dev = (spi_model_ad5724_t*) model;
+  uint8_t reg = (dev->in[0] >> AD5724_REG_Pos) & 0x07;
+  uint8_t addr = dev->in[0] & 0x07;
+  uint16_t data = (uint16_t) ((dev->in[1] << 8) | dev->in[2]);
+
+  memset(dev->out, 0, sizeof(dev->out));
+  if(dev->index != sizeof(dev->in)) return; // SYNC raised early: the frame is ignored
+
+  if(dev->in[0] & AD5724_READ) {
+    // Clocked out in the next frame
+    dev->out[0] = dev->in[0] & (uint8_t) ~AD5724_READ;
+    put_be16(&dev->out[1], ad5724_register(dev, reg, addr));
+  }
+  else {
+    ad5724_write(dev, reg, addr, data);
+  }
+}
+
+void SPI_Model_AD5724_Init(spi_model_ad5724_t* dev)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->model.Name = "AD5724";
+  dev->model.Select = ad5724_select;
+  dev->model.Exchange = ad5724_exchange;
+  dev->model.Deselect = ad5724_deselect;
+}
+
+uint16_t SPI_Model_AD5724_GetOutput(const spi_model_ad5724_t* dev, uint8_t channel)
+{
+  return (channel < SPI_MODEL_AD5724_CHANNELS) ? dev->dac[channel] : 0;
+}
+
+// MAX31865
+static void max31865_convert(spi_model_max31865_t* dev) {
+  uint16_t high = get_be16(&dev->regs[MAX31865_HFT_MSB]) >> 1;
+  uint16_t low = get_be16(&dev->regs[MAX31865_LFT_MSB]) >> 1;
+  uint8_t fault = 0;
+
+  if(dev->rtd > high) fault |= MAX31865_FAULT_HIGH;
+  if(dev->rtd < low) fault |= MAX31865_FAULT_LOW;
+
+  dev->regs[MAX31865_FAULT] |= fault;
+  put_be16(&dev->regs[MAX31865_RTD_MSB], (uint16_t) ((dev->rtd << 1) | (dev->regs[MAX31865_FAULT] != 0)));
+  dev->conversions++;
+}
+
+static void max31865_write(spi_model_max31865_t* dev, uint8_t address, uint8_t value) {
+  if(address == MAX31865_CONFIG) {
+    if(value & MAX31865_CFG_FAULT_CLEAR) {
+      dev->regs[MAX31865_FAULT] = 0;
+      dev->regs[MAX31865_RTD_LSB] &= (uint8_t) ~0x01;
+    }
+    // One-shot and fault clear are self-clearing, the conversion runs after CS goes high
+    dev->regs[MAX31865_CONFIG] = value & (uint8_t) ~MAX31865_CFG_FAULT_CLEAR;
+  }
+  else if(address >= MAX31865_HFT_MSB && address <= MAX31865_LFT_LSB) {
+    dev->regs[address] = value;
+  }
+}
+
+static void max31865_select(HAL_SPI_Host_Model_t* model) {
+  spi_model_max31865_t* dev = (spi_model_max31865_t*) model;
+  uint8_t config = dev->regs[MAX31865_CONFIG];
+
+  dev->index = 0;
+  if((config & MAX31865_CFG_VBIAS) && (config & MAX31865_CFG_AUTO)) max31865_convert(dev);
+}
+
+static uint8_t max31865_exchange(HAL_SPI_Host_Model_t* model, uint8_t mosi) {
+  spi_model_max31865_t* dev = (spi_model_max31865_t*) model;
+  uint8_t address = dev->address & (uint8_t) ~MAX31865_WRITE;
+  uint8_t miso = 0xFF;
+
+  if(dev->index == 0) {
+    dev->address = mosi;
+  }
+  else {
+    if(address < SPI_MODEL_MAX31865_REGS) {
+      if(dev->address & MAX31865_WRITE) max31865_write(dev, address, mosi);
+      else miso = dev->regs[address];
+    }
+    dev->address = (uint8_t) ((dev->address & MAX31865_WRITE) | ((address + 1) % SPI_MODEL_MAX31865_REGS));
+  }
+
+  dev->index++;
+  return miso;
+}
+
+static void max31865_deselect(HAL_SPI_Host_Model_t* model) {
+  spi_model_max31865_t* dev = (spi_model_max31865_t*) model;
+  uint8_t config = dev->regs[MAX31865_CONFIG];
+
+  if(config & MAX31865_CFG_ONESHOT) {
+    if(config & MAX31865_CFG_VBIAS) max31865_convert(dev);
+    dev->regs[MAX31865_CONFIG] &= (uint8_t) ~MAX31865_CFG_ONESHOT;
+  }
+}
+
+void SPI_Model_MAX31865_Init(spi_model_max31865_t* dev)
+{
+  memset(dev, 0, sizeof(*dev));
+  dev->model.Name = "MAX31865";
+  dev->model.Select = max31865_select;
+  dev->model.Exchange = max31865_exchange;
+  dev->model.Deselect = max31865_deselect;
+  put_be16(&dev->regs[MAX31865_HFT_MSB], 0xFFFF);
+}
+
+void SPI_Model_MAX31865_SetRtd(spi_model_max31865_t* dev, uint16_t code)
+{
+  dev->rtd = code & 0x7FFF;
+}
+
+bool SPI_Models_AttachBoard(spi_models_board_t* board)
+{
+  bool ok = true;
+
+  SPI_Model_MCP23S08_Init(&board->mcp23s08, 0);
+  SPI_Model_AD7324_Init(&board->ad7324);
+  SPI_Model_AD5724_Init(&board->ad5724);
+  SPI_Model_W5500_Init(&board->w5500);
+  SPI_Model_MAX31865_Init(&board->max31865);
+
+  ok &= HAL_SPI_Host_Attach(SPI_MODEL_MCP23S08_SPI, SPI_MODEL_MCP23S08_CS_PORT, SPI_MODEL_MCP23S08_CS_PIN,
+                            GPIO_PIN_RESET, &board->mcp23s08.model);
+  ok &= HAL_SPI_Host_Attach(SPI_MODEL_AD7324_SPI, SPI_MODEL_AD7324_CS_PORT, SPI_MODEL_AD7324_CS_PIN,
+                            GPIO_PIN_RESET, &board->ad7324.model);
+  ok &= HAL_SPI_Host_Attach(SPI_MODEL_AD5724_SPI, SPI_MODEL_AD5724_CS_PORT, SPI_MODEL_AD5724_CS_PIN,
+                            GPIO_PIN_RESET, &board->ad5724.model);
+  ok &= HAL_SPI_Host_Attach(SPI_MODEL_W5500_SPI, SPI_MODEL_W5500_CS_PORT, SPI_MODEL_W5500_CS_PIN,
+                            GPIO_PIN_RESET, &board->w5500.model);
+  ok &= HAL_SPI_Host_Attach(SPI_MODEL_MAX31865_SPI, SPI_MODEL_MAX31865_CS_PORT, SPI_MODEL_MAX31865_CS_PIN,
+                            GPIO_PIN_RESET, &board->max31865.model);
+  return ok;
+}
@@ -0,0 +1,161 @@
+/*
+ * spi_models_host.h
+ *
+ *  Device models of the board for the host SPI bus (see hal_spi_host.h).
+ *  Each model keeps the register state of its device and decodes the frames
+ *  byte by byte like the real shift register, so the drivers and the SPI
+ *  layer run unchanged against them:
+ *
+ *    W5500     3 byte header (address, control), variable length data,
+ *              common/socket registers and TX/RX buffer memory
+ *    MCP23S08  opcode, register address, sequential register access
+ *    AD7324    16 bit frames, control/range/sequence registers, the result
+ *              of the channel set up in the previous frame is clocked out
+ *    AD5724    24 bit frames, DAC/range/power/control registers, readback
+ *              in the following frame
+ *    MAX31865  address byte, sequential register access, RTD conversion
+ *
+ *  Analog values and pins are set and read back through the functions below.
+ *  Timing of the devices (conversion time, reset time) is not modelled.
+ */
+
+#ifndef HOST_SPI_MODELS_HOST_H_
+#define HOST_SPI_MODELS_HOST_H_
+
+#include "hal_spi_host.h"
+
+#define SPI_MODEL_W5500_SOCKETS       8
+#define SPI_MODEL_W5500_BUF_SIZE      0x4000 // Largest socket buffer (16 KiB)
+#define SPI_MODEL_W5500_COMMON_SIZE   0x40
+#define SPI_MODEL_W5500_SOCKET_SIZE   0x30
+#define SPI_MODEL_W5500_VERSION       0x04
+
+#define SPI_MODEL_MCP23S08_REGS       11
+#define SPI_MODEL_AD7324_CHANNELS     4
+#define SPI_MODEL_AD5724_CHANNELS     4
+#define SPI_MODEL_MAX31865_REGS       8
+
+// Wiring of the board, same as spi_device_configs[] (spi_device_config.h)
+#define SPI_MODEL_MCP23S08_SPI        SPI1
+#define SPI_MODEL_MCP23S08_CS_PORT    GPIOI
+#define SPI_MODEL_MCP23S08_CS_PIN     GPIO_PIN_1
+#define SPI_MODEL_AD7324_SPI          SPI1
+#define SPI_MODEL_AD7324_CS_PORT      GPIOI
+#define SPI_MODEL_AD7324_CS_PIN       GPIO_PIN_4
+#define SPI_MODEL_AD5724_SPI          SPI1
+#define SPI_MODEL_AD5724_CS_PORT      GPIOI
+#define SPI_MODEL_AD5724_CS_PIN       GPIO_PIN_5
+#define SPI_MODEL_W5500_SPI           SPI2
+#define SPI_MODEL_W5500_CS_PORT       GPIOH
+#define SPI_MODEL_W5500_CS_PIN        GPIO_PIN_3
+#define SPI_MODEL_MAX31865_SPI        SPI2 // Add-on slot SPI_ADDON2
+#define SPI_MODEL_MAX31865_CS_PORT    GPIOA
+#define SPI_MODEL_MAX31865_CS_PIN     GPIO_PIN_2
+
+typedef struct __SPI_Model_W5500_TypeDef
+{
+  HAL_SPI_Host_Model_t  model;
+  uint8_t               common[SPI_MODEL_W5500_COMMON_SIZE];
+  uint8_t               socket[SPI_MODEL_W5500_SOCKETS][SPI_MODEL_W5500_SOCKET_SIZE];
+  uint8_t               tx_buf[SPI_MODEL_W5500_SOCKETS][SPI_MODEL_W5500_BUF_SIZE];
+  uint8_t               rx_buf[SPI_MODEL_W5500_SOCKETS][SPI_MODEL_W5500_BUF_SIZE];
+  uint32_t              sent[SPI_MODEL_W5500_SOCKETS]; // Bytes taken by SEND commands
+
+  // Frame
+  uint32_t              index;
+  uint16_t              address;
+  uint8_t               control;
+}spi_model_w5500_t;
+
+typedef struct __SPI_Model_MCP23S08_TypeDef
+{
+  HAL_SPI_Host_Model_t  model;
+  uint8_t               hw_address; // A1, A0
+  uint8_t               regs[SPI_MODEL_MCP23S08_REGS];
+  uint8_t               inputs;     // Level at the pins
+
+  // Frame
+  uint32_t              index;
+  uint8_t               opcode;
+  uint8_t               reg;
+}spi_model_mcp23s08_t;
+
+typedef struct __SPI_Model_AD7324_TypeDef
+{
+  HAL_SPI_Host_Model_t  model;
+  uint16_t              control;
+  uint16_t              range;
+  uint16_t              sequence;
+  int16_t               inputs[SPI_MODEL_AD7324_CHANNELS]; // 13 bit codes, -4096..4095
+  uint32_t              conversions;
+
+  // Frame
+  uint32_t              index;
+  uint8_t               channel;    // Converted on the next CS falling edge
+  uint16_t              in;
+  uint16_t              out;
+}spi_model_ad7324_t;
+
+typedef struct __SPI_Model_AD5724_TypeDef
+{
+  HAL_SPI_Host_Model_t  model;
+  uint16_t              dac[SPI_MODEL_AD5724_CHANNELS];   // 12 bit codes
+  uint16_t              range[SPI_MODEL_AD5724_CHANNELS];
+  uint16_t              power;
+  uint16_t              control;
+
+  // Frame
+  uint32_t              index;
+  uint8_t               in[3];
+  uint8_t               out[3];     // Readback requested by the previous frame
+}spi_model_ad5724_t;
+
+typedef struct __SPI_Model_MAX31865_TypeDef
+{
+  HAL_SPI_Host_Model_t  model;
+  uint8_t               regs[SPI_MODEL_MAX31865_REGS];
+  uint16_t              rtd;        // 15 bit ADC code, RTD / RREF * 2^15
+  uint32_t              conversions;
+
+  // Frame
+  uint32_t              index;
+  uint8_t               address;
+}spi_model_max31865_t;
+
+// All devices of the board, see SPI_Models_AttachBoard()
+typedef struct __SPI_Models_Board_TypeDef
+{
+  spi_model_mcp23s08_t  mcp23s08;
+  spi_model_ad7324_t    ad7324;
+  spi_model_ad5724_t    ad5724;
+  spi_model_w5500_t     w5500;
+  spi_model_max31865_t  max31865;
+}spi_models_board_t;
+
+// Power-on state
+void SPI_Model_W5500_Init(spi_model_w5500_t* dev);
+void SPI_Model_MCP23S08_Init(spi_model_mcp23s08_t* dev, uint8_t hw_address);
+void SPI_Model_AD7324_Init(spi_model_ad7324_t* dev);
+void SPI_Model_AD5724_Init(spi_model_ad5724_t* dev);
+void SPI_Model_MAX31865_Init(spi_model_max31865_t* dev);
+
+// Initialises all models and attaches them at the board wiring, returns false if a bus is full
+bool SPI_Models_AttachBoard(spi_models_board_t* board);
+
+// W5500: stores received data in the RX buffer of a socket, returns the bytes taken
+uint16_t SPI_Model_W5500_Receive(spi_model_w5500_t* dev, uint8_t sn, const uint8_t* data, uint16_t len);
+
+// MCP23S08: level at the input pins, outputs driven by OLAT
+void SPI_Model_MCP23S08_SetInputs(spi_model_mcp23s08_t* dev, uint8_t pins);
+uint8_t SPI_Model_MCP23S08_GetOutputs(const spi_model_mcp23s08_t* dev);
+
+// AD7324: conversion result of a channel (two's complement, 13 bit)
+void SPI_Model_AD7324_SetInput(spi_model_ad7324_t* dev, uint8_t channel, int16_t code);
+
+// AD5724: 12 bit code of a DAC output
+uint16_t SPI_Model_AD5724_GetOutput(const spi_model_ad5724_t* dev, uint8_t channel);
+
+// MAX31865: 15 bit ADC code of the next conversion
+void SPI_Model_MAX31865_SetRtd(spi_model_max31865_t* dev, uint16_t code);
+
+#endif /* HOST_SPI_MODELS_HOST_H_ */
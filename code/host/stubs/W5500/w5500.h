@@ -0,0 +1,8 @@
+/*
+ * w5500.h
+ *
+ *  Host build: the firmware includes the driver as W5500/w5500.h from the
+ *  ioLibrary, in this tree it is code/w5500.h
+ */
+
+#include "../../../w5500.h"
@@ -0,0 +1,11 @@
+/*
+ * ad5724_dac.h
+ *
+ *  Host build: the AD5724 driver is not part of the host build, the bench talks to
+ *  its model through the bus layer directly (spi_models_host.c)
+ */
+
+#ifndef HOST_AD5724_DAC_H_
+#define HOST_AD5724_DAC_H_
+
+#endif /* HOST_AD5724_DAC_H_ */
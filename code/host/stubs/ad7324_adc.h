@@ -0,0 +1,11 @@
+/*
+ * ad7324_adc.h
+ *
+ *  Host build: the AD7324 driver is not part of the host build, the bench talks to
+ *  its model through the bus layer directly (spi_models_host.c)
+ */
+
+#ifndef HOST_AD7324_ADC_H_
+#define HOST_AD7324_ADC_H_
+
+#endif /* HOST_AD7324_ADC_H_ */
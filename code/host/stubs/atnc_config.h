@@ -0,0 +1,32 @@
+/*
+ * atnc_config.h
+ *
+ *  Host build: the unit configuration of the board and the identifiers the
+ *  SPI layer and the W5500 driver use
+ */
+
+#ifndef HOST_ATNC_CONFIG_H_
+#define HOST_ATNC_CONFIG_H_
+
+#include <stdint.h>
+
+#include "config_zzz_DEMO-2022a.h"
+
+typedef uint8_t device_id_t;
+typedef uint8_t devicetype_t;
+
+// Device types
+#define SPI_NO_DEVICE_TYPE  0
+#define WIZNET_W5500        1
+
+// Digital inputs
+#define SID_ETHERNET        0
+#define DI_W5500            0
+
+#ifdef ETHERNET_DBGOUT
+#define ETHERNET_DBGOUT_ON  1
+#else
+#define ETHERNET_DBGOUT_ON  0
+#endif
+
+#endif /* HOST_ATNC_CONFIG_H_ */
@@ -0,0 +1,36 @@
+/*
+ * board_host.c
+ *
+ *  Host build: digital input interrupts and the Ethernet debug output of the
+ *  firmware (gpio.h, serial.h)
+ */
+
+#include "gpio.h"
+#include "serial.h"
+
+#include <stdio.h>
+
+// The host has no interrupt lines, registrations always succeed and never fire
+uint8_t GPIO_DI_Int_Reg(uint8_t ID, GPIO_DI_TypeDef DI, PinTriggerEdge_TypeDef edge, GPIO_DI_Callback_t callback)
+{
+  UNUSED(ID);
+  UNUSED(edge);
+  UNUSED(callback);
+  return DI;
+}
+
+void GPIO_DI_Int_Enable(uint8_t ID, GPIO_DI_TypeDef DI)
+{
+  UNUSED(ID);
+  UNUSED(DI);
+}
+
+void debugEthPrintWithInfo(uint16_t port, uint8_t sockNum, uint8_t* data, int32_t len)
+{
+  printf("[eth %u/%u] %.*s\n", port, sockNum, (int) len, (const char*) data);
+}
+
+void debugEthPrintWithInfoStr(uint16_t port, uint8_t sockNum, uint8_t* text)
+{
+  printf("[eth %u/%u] %s\n", port, sockNum, (const char*) text);
+}
@@ -0,0 +1,44 @@
+/*
+ * cmsis_os.h
+ *
+ *  Host build: the CMSIS-OS (v1) semaphore subset implemented by cmsis_os_host.c
+ */
+
+#ifndef HOST_CMSIS_OS_H_
+#define HOST_CMSIS_OS_H_
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "stm32f7xx_hal.h"
+
+#define osWaitForever     0xFFFFFFFFU
+
+typedef enum
+{
+  osOK                   = 0,
+  osEventTimeout         = 0x40,
+  osErrorParameter       = 0x80,
+  osErrorResource        = 0x81,
+  osErrorTimeoutResource = 0xC1,
+  osErrorISR             = 0x82,
+  osErrorOS              = 0xFF
+} osStatus;
+
+typedef SemaphoreHandle_t osSemaphoreId;
+
+typedef struct os_semaphore_def
+{
+  uint32_t dummy;
+} osSemaphoreDef_t;
+
+#define osSemaphoreDef(name)  const osSemaphoreDef_t os_semaphore_def_##name = { 0 }
+#define osSemaphore(name)     &os_semaphore_def_##name
+
+osSemaphoreId osSemaphoreCreate(const osSemaphoreDef_t* semaphore_def, int32_t count);
+int32_t osSemaphoreWait(osSemaphoreId semaphore_id, uint32_t millisec);
+osStatus osSemaphoreRelease(osSemaphoreId semaphore_id);
+osStatus osDelay(uint32_t millisec);
+
+#endif /* HOST_CMSIS_OS_H_ */
@@ -0,0 +1,21 @@
+/*
+ * generic_bus_device_datatypes.h
+ *
+ *  Host build: the bus device fields the W5500 driver uses
+ */
+
+#ifndef HOST_GENERIC_BUS_DEVICE_DATATYPES_H_
+#define HOST_GENERIC_BUS_DEVICE_DATATYPES_H_
+
+#include "atnc_config.h"
+#include "spi_devices.h"
+
+typedef struct bus_device
+{
+  spi_device_t  spi_device_handle;
+  bool          init;
+  bool          error;
+  void          (*re_configure)(void* gen_device_h);
+} bus_device_t;
+
+#endif /* HOST_GENERIC_BUS_DEVICE_DATATYPES_H_ */
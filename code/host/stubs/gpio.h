@@ -0,0 +1,28 @@
+/*
+ * gpio.h
+ *
+ *  Host build: digital input interrupt registration, see board_host.c
+ */
+
+#ifndef HOST_GPIO_H_
+#define HOST_GPIO_H_
+
+#include "stm32f7xx_hal.h"
+#include "atnc_config.h"
+
+#define GPIO_NO_ENTRY   0xFF  // Returned by GPIO_DI_Int_Reg() if no slot is free
+
+typedef uint8_t GPIO_DI_TypeDef;
+
+typedef enum
+{
+  falling = 0,
+  rising
+} PinTriggerEdge_TypeDef;
+
+typedef void (*GPIO_DI_Callback_t)(uint8_t ID, GPIO_DI_TypeDef DI, PinTriggerEdge_TypeDef edge);
+
+uint8_t GPIO_DI_Int_Reg(uint8_t ID, GPIO_DI_TypeDef DI, PinTriggerEdge_TypeDef edge, GPIO_DI_Callback_t callback);
+void GPIO_DI_Int_Enable(uint8_t ID, GPIO_DI_TypeDef DI);
+
+#endif /* HOST_GPIO_H_ */
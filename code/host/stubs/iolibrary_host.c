@@ -0,0 +1,153 @@
+/*
+ * iolibrary_host.c
+ *
+ *  Host build: the parts of the WIZnet ioLibrary (wizchip_conf.c, socket.c)
+ *  the W5500 driver and ethernet_interface.c call. The socket functions issue
+ *  the register accesses of the ioLibrary, without waiting for the command and
+ *  status changes a real chip would make.
+ */
+
+#include "socket.h"
+#include "W5500/w5500.h"
+
+static void wizchip_host_cris(void)
+{
+}
+
+_WIZCHIP WIZCHIP = {
+  .if_mode = _WIZCHIP_IO_MODE_,
+  .id = _WIZCHIP_ID_,
+  .CRIS = { wizchip_host_cris, wizchip_host_cris },
+};
+
+// wizchip_conf.c
+void reg_wizchip_device_handle(void* gen_device_h)
+{
+  WIZCHIP.gen_device_h = gen_device_h;
+}
+
+void reg_wizchip_cris_cbfunc(void (*cris_en)(void), void (*cris_ex)(void))
+{
+  WIZCHIP.CRIS._enter = (cris_en != NULL) ? cris_en : wizchip_host_cris;
+  WIZCHIP.CRIS._exit = (cris_ex != NULL) ? cris_ex : wizchip_host_cris;
+}
+
+void reg_wizchip_cs_cbfunc(void (*cs_sel)(void), void (*cs_desel)(void))
+{
+  WIZCHIP.CS._select = cs_sel;
+  WIZCHIP.CS._deselect = cs_desel;
+}
+
+void reg_wizchip_spiburst_cbfunc(void (*spi_rb)(uint8_t* pBuf, uint16_t len), void (*spi_wb)(uint8_t* pBuf, uint16_t len))
+{
+  WIZCHIP.IF.SPI._read_burst = spi_rb;
+  WIZCHIP.IF.SPI._write_burst = spi_wb;
+}
+
+void reg_wizchip_spi_write_then_read_cbfunc(void (*spi_wtr)(uint8_t* pTx, uint8_t tx_len, uint8_t* pRx, uint8_t rx_len))
+{
+  WIZCHIP.IF.SPI._write_then_read = spi_wtr;
+}
+
+int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize)
+{
+  for(uint8_t sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++) {
+    if(txsize != NULL) setSn_TXBUF_SIZE(sn, txsize[sn]);
+    if(rxsize != NULL) setSn_RXBUF_SIZE(sn, rxsize[sn]);
+  }
+  return 0;
+}
+
+void wizchip_setnetinfo(wiz_NetInfo* pnetinfo)
+{
+  setSHAR(pnetinfo->mac);
+  setGAR(pnetinfo->gw);
+  setSUBR(pnetinfo->sn);
+  setSIPR(pnetinfo->ip);
+}
+
+void wizchip_getnetinfo(wiz_NetInfo* pnetinfo)
+{
+  getSHAR(pnetinfo->mac);
+  getGAR(pnetinfo->gw);
+  getSUBR(pnetinfo->sn);
+  getSIPR(pnetinfo->ip);
+  pnetinfo->dhcp = NETINFO_STATIC;
+}
+
+void wizchip_setinterruptmask(intr_kind intr)
+{
+  setIMR((uint8_t) intr);
+  setSIMR((uint8_t) (intr >> 8));
+}
+
+void wizchip_clrinterrupt(intr_kind intr)
+{
+  setIR((uint8_t) intr);
+  setSIR((uint8_t) (intr >> 8));
+}
+
+// socket.c
+int8_t socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag)
+{
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+
+  setSn_MR(sn, (uint8_t) (protocol | flag));
+  setSn_PORT(sn, port);
+  setSn_CR(sn, Sn_CR_OPEN);
+  return (int8_t) sn;
+}
+
+int8_t close(uint8_t sn)
+{
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+
+  setSn_CR(sn, Sn_CR_CLOSE);
+  setSn_IR(sn, 0xFF);
+  return SOCK_OK;
+}
+
+int8_t listen(uint8_t sn)
+{
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+
+  setSn_CR(sn, Sn_CR_LISTEN);
+  return SOCK_OK;
+}
+
+int32_t send(uint8_t sn, uint8_t* buf, uint16_t len)
+{
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+  if(len == 0) return SOCKERR_DATALEN;
+
+  wiz_send_data(sn, buf, len);
+  setSn_CR(sn, Sn_CR_SEND);
+  return len;
+}
+
+int32_t sendto_W5x00(uint8_t sn, uint8_t* buf, uint16_t len, uint8_t* addr, uint16_t port)
+{
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+  if(len == 0) return SOCKERR_DATALEN;
+
+  setSn_DIPR(sn, addr);
+  setSn_DPORT(sn, port);
+  wiz_send_data(sn, buf, len);
+  setSn_CR(sn, Sn_CR_SEND);
+  return len;
+}
+
+int32_t recv(uint8_t sn, uint8_t* buf, uint16_t len)
+{
+  uint16_t received;
+
+  if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+
+  received = getSn_RX_RSR(sn);
+  if(received == 0) return SOCK_BUSY;
+  if(received < len) len = received;
+
+  wiz_recv_data(sn, buf, len);
+  setSn_CR(sn, Sn_CR_RECV);
+  return len;
+}
@@ -0,0 +1,11 @@
+/*
+ * max31865_rtd.h
+ *
+ *  Host build: the MAX31865 driver is not part of the host build, the bench talks to
+ *  its model through the bus layer directly (spi_models_host.c)
+ */
+
+#ifndef HOST_MAX31865_RTD_H_
+#define HOST_MAX31865_RTD_H_
+
+#endif /* HOST_MAX31865_RTD_H_ */
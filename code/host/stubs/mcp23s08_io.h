@@ -0,0 +1,11 @@
+/*
+ * mcp23s08_io.h
+ *
+ *  Host build: the MCP23S08 driver is not part of the host build, the bench talks to
+ *  its model through the bus layer directly (spi_models_host.c)
+ */
+
+#ifndef HOST_MCP23S08_IO_H_
+#define HOST_MCP23S08_IO_H_
+
+#endif /* HOST_MCP23S08_IO_H_ */
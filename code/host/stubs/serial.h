@@ -0,0 +1,15 @@
+/*
+ * serial.h
+ *
+ *  Host build: the Ethernet debug output goes to stdout, see board_host.c
+ */
+
+#ifndef HOST_SERIAL_H_
+#define HOST_SERIAL_H_
+
+#include <stdint.h>
+
+void debugEthPrintWithInfo(uint16_t port, uint8_t sockNum, uint8_t* data, int32_t len);
+void debugEthPrintWithInfoStr(uint16_t port, uint8_t sockNum, uint8_t* text);
+
+#endif /* HOST_SERIAL_H_ */
@@ -0,0 +1,41 @@
+/*
+ * socket.h
+ *
+ *  Host build: the WIZnet ioLibrary socket API used by ethernet_interface.c,
+ *  implemented by iolibrary_host.c on the W5500 registers
+ */
+
+#ifndef HOST_SOCKET_H_
+#define HOST_SOCKET_H_
+
+#include <stdint.h>
+
+#include "wizchip_conf.h"
+
+// The ioLibrary names clash with the socket API of the host C library
+#define socket  wizchip_host_socket
+#define close   wizchip_host_close
+#define listen  wizchip_host_listen
+#define send    wizchip_host_send
+#define recv    wizchip_host_recv
+
+#define SOCK_OK               1
+#define SOCK_BUSY             0
+#define SOCK_FATAL            -1000
+
+#define SOCK_ERROR            0
+#define SOCKERR_SOCKNUM       (SOCK_ERROR - 1)
+#define SOCKERR_SOCKOPT       (SOCK_ERROR - 2)
+#define SOCKERR_SOCKINIT      (SOCK_ERROR - 3)
+#define SOCKERR_SOCKCLOSED    (SOCK_ERROR - 4)
+#define SOCKERR_SOCKMODE      (SOCK_ERROR - 5)
+#define SOCKERR_DATALEN       (SOCK_ERROR - 14)
+
+int8_t  socket(uint8_t sn, uint8_t protocol, uint16_t port, uint8_t flag);
+int8_t  close(uint8_t sn);
+int8_t  listen(uint8_t sn);
+int32_t send(uint8_t sn, uint8_t* buf, uint16_t len);
+int32_t sendto_W5x00(uint8_t sn, uint8_t* buf, uint16_t len, uint8_t* addr, uint16_t port);
+int32_t recv(uint8_t sn, uint8_t* buf, uint16_t len);
+
+#endif /* HOST_SOCKET_H_ */
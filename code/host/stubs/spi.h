@@ -0,0 +1,14 @@
+/*
+ * spi.h
+ *
+ *  Host build: CubeMX SPI module, SPI_Init() is implemented by hal_spi_host.c
+ */
+
+#ifndef HOST_SPI_H_
+#define HOST_SPI_H_
+
+#include "stm32f7xx_hal.h"
+
+SPI_HandleTypeDef* SPI_Init(SPI_TypeDef* instance);
+
+#endif /* HOST_SPI_H_ */
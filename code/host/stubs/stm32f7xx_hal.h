@@ -0,0 +1,250 @@
+/*
+ * stm32f7xx_hal.h
+ *
+ *  Host build: the STM32F7 HAL types, constants and prototypes the SPI layer
+ *  uses, with the values of the Cube headers. The functions are implemented by
+ *  hal_spi_host.c. Peripheral instances are the target addresses, they only
+ *  serve as keys on the host and are never dereferenced.
+ */
+
+#ifndef HOST_STM32F7XX_HAL_H_
+#define HOST_STM32F7XX_HAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef UNUSED
+#define UNUSED(X) (void)X
+#endif
+#define __weak      __attribute__((weak))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __DMB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DSB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+extern uint32_t SystemCoreClock;
+
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+// Peripherals
+typedef struct
+{
+  volatile uint32_t CR1, CR2, SR, DR, CRCPR, RXCRCR, TXCRCR, I2SCFGR, I2SPR;
+} SPI_TypeDef;
+
+typedef struct
+{
+  volatile uint32_t MODER, OTYPER, OSPEEDR, PUPDR, IDR, ODR, BSRR, LCKR, AFR[2];
+} GPIO_TypeDef;
+
+typedef struct
+{
+  volatile uint32_t CR, NDTR, PAR, M0AR, M1AR, FCR;
+} DMA_Stream_TypeDef;
+
+#define PERIPH_BASE       0x40000000UL
+#define APB1PERIPH_BASE   PERIPH_BASE
+#define APB2PERIPH_BASE   (PERIPH_BASE + 0x00010000UL)
+#define AHB1PERIPH_BASE   (PERIPH_BASE + 0x00020000UL)
+
+#define SPI2_BASE         (APB1PERIPH_BASE + 0x3800UL)
+#define SPI3_BASE         (APB1PERIPH_BASE + 0x3C00UL)
+#define SPI1_BASE         (APB2PERIPH_BASE + 0x3000UL)
+#define SPI4_BASE         (APB2PERIPH_BASE + 0x3400UL)
+#define SPI5_BASE         (APB2PERIPH_BASE + 0x5000UL)
+#define SPI6_BASE         (APB2PERIPH_BASE + 0x5400UL)
+#define GPIOA_BASE        (AHB1PERIPH_BASE + 0x0000UL)
+#define GPIOB_BASE        (AHB1PERIPH_BASE + 0x0400UL)
+#define GPIOC_BASE        (AHB1PERIPH_BASE + 0x0800UL)
+#define GPIOD_BASE        (AHB1PERIPH_BASE + 0x0C00UL)
+#define GPIOE_BASE        (AHB1PERIPH_BASE + 0x1000UL)
+#define GPIOF_BASE        (AHB1PERIPH_BASE + 0x1400UL)
+#define GPIOG_BASE        (AHB1PERIPH_BASE + 0x1800UL)
+#define GPIOH_BASE        (AHB1PERIPH_BASE + 0x1C00UL)
+#define GPIOI_BASE        (AHB1PERIPH_BASE + 0x2000UL)
+#define GPIOJ_BASE        (AHB1PERIPH_BASE + 0x2400UL)
+#define GPIOK_BASE        (AHB1PERIPH_BASE + 0x2800UL)
+
+#define SPI1              ((SPI_TypeDef *) SPI1_BASE)
+#define SPI2              ((SPI_TypeDef *) SPI2_BASE)
+#define SPI3              ((SPI_TypeDef *) SPI3_BASE)
+#define SPI4              ((SPI_TypeDef *) SPI4_BASE)
+#define SPI5              ((SPI_TypeDef *) SPI5_BASE)
+#define SPI6              ((SPI_TypeDef *) SPI6_BASE)
+#define GPIOA             ((GPIO_TypeDef *) GPIOA_BASE)
+#define GPIOB             ((GPIO_TypeDef *) GPIOB_BASE)
+#define GPIOC             ((GPIO_TypeDef *) GPIOC_BASE)
+#define GPIOD             ((GPIO_TypeDef *) GPIOD_BASE)
+#define GPIOE             ((GPIO_TypeDef *) GPIOE_BASE)
+#define GPIOF             ((GPIO_TypeDef *) GPIOF_BASE)
+#define GPIOG             ((GPIO_TypeDef *) GPIOG_BASE)
+#define GPIOH             ((GPIO_TypeDef *) GPIOH_BASE)
+#define GPIOI             ((GPIO_TypeDef *) GPIOI_BASE)
+#define GPIOJ             ((GPIO_TypeDef *) GPIOJ_BASE)
+#define GPIOK             ((GPIO_TypeDef *) GPIOK_BASE)
+
+// GPIO
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0                ((uint16_t)0x0001)
+#define GPIO_PIN_1                ((uint16_t)0x0002)
+#define GPIO_PIN_2                ((uint16_t)0x0004)
+#define GPIO_PIN_3                ((uint16_t)0x0008)
+#define GPIO_PIN_4                ((uint16_t)0x0010)
+#define GPIO_PIN_5                ((uint16_t)0x0020)
+#define GPIO_PIN_6                ((uint16_t)0x0040)
+#define GPIO_PIN_7                ((uint16_t)0x0080)
+#define GPIO_PIN_8                ((uint16_t)0x0100)
+#define GPIO_PIN_9                ((uint16_t)0x0200)
+#define GPIO_PIN_10               ((uint16_t)0x0400)
+#define GPIO_PIN_11               ((uint16_t)0x0800)
+#define GPIO_PIN_12               ((uint16_t)0x1000)
+#define GPIO_PIN_13               ((uint16_t)0x2000)
+#define GPIO_PIN_14               ((uint16_t)0x4000)
+#define GPIO_PIN_15               ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT           0x00000000U
+#define GPIO_MODE_OUTPUT_PP       0x00000001U
+#define GPIO_NOPULL               0x00000000U
+#define GPIO_PULLUP               0x00000001U
+#define GPIO_SPEED_FREQ_HIGH      0x00000002U
+#define GPIO_SPEED_FREQ_VERY_HIGH 0x00000003U
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+// DMA
+typedef struct __DMA_HandleTypeDef
+{
+  DMA_Stream_TypeDef* Instance;
+} DMA_HandleTypeDef;
+
+// SPI
+#define SPI_CR1_CPHA              0x00000001U
+#define SPI_CR1_CPOL              0x00000002U
+#define SPI_CR1_MSTR              0x00000004U
+#define SPI_CR1_BR_Pos            (3U)
+#define SPI_CR1_BR                (0x7UL << SPI_CR1_BR_Pos)
+#define SPI_CR1_SPE               0x00000040U
+#define SPI_CR1_LSBFIRST          0x00000080U
+#define SPI_CR1_SSI               0x00000100U
+#define SPI_CR1_SSM               0x00000200U
+
+#define SPI_MODE_SLAVE            0x00000000U
+#define SPI_MODE_MASTER           (SPI_CR1_MSTR | SPI_CR1_SSI)
+#define SPI_DIRECTION_2LINES      0x00000000U
+#define SPI_DATASIZE_8BIT         0x00000700U
+#define SPI_DATASIZE_16BIT        0x00000F00U
+#define SPI_POLARITY_LOW          0x00000000U
+#define SPI_POLARITY_HIGH         SPI_CR1_CPOL
+#define SPI_PHASE_1EDGE           0x00000000U
+#define SPI_PHASE_2EDGE           SPI_CR1_CPHA
+#define SPI_NSS_SOFT              SPI_CR1_SSM
+#define SPI_FIRSTBIT_MSB          0x00000000U
+#define SPI_FIRSTBIT_LSB          SPI_CR1_LSBFIRST
+#define SPI_TIMODE_DISABLE        0x00000000U
+#define SPI_CRCCALCULATION_DISABLE 0x00000000U
+#define SPI_CRC_LENGTH_DATASIZE   0x00000000U
+#define SPI_NSS_PULSE_DISABLE     0x00000000U
+#define SPI_NSS_PULSE_ENABLE      0x00000008U
+
+#define SPI_BAUDRATEPRESCALER_2   0x00000000U
+#define SPI_BAUDRATEPRESCALER_4   0x00000008U
+#define SPI_BAUDRATEPRESCALER_8   0x00000010U
+#define SPI_BAUDRATEPRESCALER_16  0x00000018U
+#define SPI_BAUDRATEPRESCALER_32  0x00000020U
+#define SPI_BAUDRATEPRESCALER_64  0x00000028U
+#define SPI_BAUDRATEPRESCALER_128 0x00000030U
+#define SPI_BAUDRATEPRESCALER_256 0x00000038U
+
+#define HAL_SPI_ERROR_NONE        0x00000000U
+#define HAL_SPI_ERROR_MODF        0x00000001U
+#define HAL_SPI_ERROR_OVR         0x00000004U
+#define HAL_SPI_ERROR_DMA         0x00000010U
+#define HAL_SPI_ERROR_FLAG        0x00000020U
+#define HAL_SPI_ERROR_ABORT       0x00000040U
+
+typedef struct
+{
+  uint32_t Mode;
+  uint32_t Direction;
+  uint32_t DataSize;
+  uint32_t CLKPolarity;
+  uint32_t CLKPhase;
+  uint32_t NSS;
+  uint32_t BaudRatePrescaler;
+  uint32_t FirstBit;
+  uint32_t TIMode;
+  uint32_t CRCCalculation;
+  uint32_t CRCPolynomial;
+  uint32_t CRCLength;
+  uint32_t NSSPMode;
+} SPI_InitTypeDef;
+
+typedef enum
+{
+  HAL_SPI_STATE_RESET      = 0x00U,
+  HAL_SPI_STATE_READY      = 0x01U,
+  HAL_SPI_STATE_BUSY       = 0x02U,
+  HAL_SPI_STATE_BUSY_TX    = 0x03U,
+  HAL_SPI_STATE_BUSY_RX    = 0x04U,
+  HAL_SPI_STATE_BUSY_TX_RX = 0x05U,
+  HAL_SPI_STATE_ERROR      = 0x06U,
+  HAL_SPI_STATE_ABORT      = 0x07U
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef
+{
+  SPI_TypeDef*                   Instance;
+  SPI_InitTypeDef                Init;
+  DMA_HandleTypeDef*             hdmatx;
+  DMA_HandleTypeDef*             hdmarx;
+  volatile HAL_SPI_StateTypeDef  State;
+  volatile uint32_t              ErrorCode;
+} SPI_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size,
+                                          uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_IT(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_IT(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_IT(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef* hspi, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef* hspi, uint8_t* pTxData, uint8_t* pRxData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi);
+HAL_StatusTypeDef HAL_SPI_Abort_IT(SPI_HandleTypeDef* hspi);
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi);
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef* hspi);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi);
+void HAL_SPI_AbortCpltCallback(SPI_HandleTypeDef* hspi);
+
+// RCC, tick
+uint32_t HAL_RCC_GetPCLK1Freq(void);
+uint32_t HAL_RCC_GetPCLK2Freq(void);
+uint32_t HAL_GetTick(void);
+
+#endif /* HOST_STM32F7XX_HAL_H_ */
@@ -0,0 +1,11 @@
+/*
+ * tmc5160_stepper_cwrapper.h
+ *
+ *  Host build: the TMC5160 driver is not part of the host build, the bench talks to
+ *  its model through the bus layer directly (spi_models_host.c)
+ */
+
+#ifndef HOST_TMC5160_STEPPER_CWRAPPER_H_
+#define HOST_TMC5160_STEPPER_CWRAPPER_H_
+
+#endif /* HOST_TMC5160_STEPPER_CWRAPPER_H_ */
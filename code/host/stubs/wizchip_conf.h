@@ -0,0 +1,110 @@
+/*
+ * wizchip_conf.h
+ *
+ *  Host build: the WIZnet ioLibrary configuration of the firmware, with its
+ *  device handle and _write_then_read extensions. Implemented by iolibrary_host.c.
+ */
+
+#ifndef HOST_WIZCHIP_CONF_H_
+#define HOST_WIZCHIP_CONF_H_
+
+#include <stdint.h>
+
+#define W5100                       5100
+#define W5200                       5200
+#define W5300                       5300
+#define W5500                       5500
+
+#include "atnc_config.h"  // _WIZCHIP_, network and socket buffer configuration
+
+#ifndef _WIZCHIP_
+#define _WIZCHIP_                   W5500
+#endif
+
+#define _WIZCHIP_IO_MODE_SPI_       0x0200
+#define _WIZCHIP_IO_MODE_SPI_VDM_   (_WIZCHIP_IO_MODE_SPI_ + 1)
+#define _WIZCHIP_IO_MODE_SPI_FDM_   (_WIZCHIP_IO_MODE_SPI_ + 2)
+#define _WIZCHIP_IO_MODE_           _WIZCHIP_IO_MODE_SPI_VDM_
+#define _WIZCHIP_ID_                "W5500\0"
+#define _WIZCHIP_IO_BASE_           0x00000000
+#define _WIZCHIP_SOCK_NUM_          8
+
+typedef struct __WIZCHIP
+{
+  uint16_t  if_mode;
+  uint8_t   id[8];
+  void*     gen_device_h;   // bus_device_t of the W5500, see reg_wizchip_device_handle()
+
+  struct _CRIS
+  {
+    void (*_enter)(void);
+    void (*_exit)(void);
+  } CRIS;
+
+  struct _CS
+  {
+    void (*_select)(void);
+    void (*_deselect)(void);
+  } CS;
+
+  union _IF
+  {
+    struct _SPI
+    {
+      uint8_t (*_read_byte)(void);
+      void    (*_write_byte)(uint8_t wb);
+      void    (*_read_burst)(uint8_t* pBuf, uint16_t len);
+      void    (*_write_burst)(uint8_t* pBuf, uint16_t len);
+      void    (*_write_then_read)(uint8_t* pTx, uint8_t tx_len, uint8_t* pRx, uint8_t rx_len);
+    } SPI;
+  } IF;
+} _WIZCHIP;
+
+extern _WIZCHIP WIZCHIP;
+
+typedef enum
+{
+  IK_WOL               = (1 << 4),
+  IK_PPPOE_TERMINATED  = (1 << 5),
+  IK_DEST_UNREACH      = (1 << 6),
+  IK_IP_CONFLICT       = (1 << 7),
+  IK_SOCK_0            = (1 << 8),
+  IK_SOCK_1            = (1 << 9),
+  IK_SOCK_2            = (1 << 10),
+  IK_SOCK_3            = (1 << 11),
+  IK_SOCK_4            = (1 << 12),
+  IK_SOCK_5            = (1 << 13),
+  IK_SOCK_6            = (1 << 14),
+  IK_SOCK_7            = (1 << 15),
+  IK_SOCK_ALL          = (0xFF << 8)
+} intr_kind;
+
+typedef enum
+{
+  NETINFO_STATIC = 1,
+  NETINFO_DHCP
+} dhcp_mode;
+
+typedef struct wiz_NetInfo_t
+{
+  uint8_t   mac[6];
+  uint8_t   ip[4];
+  uint8_t   sn[4];
+  uint8_t   gw[4];
+  uint8_t   dns[4];
+  dhcp_mode dhcp;
+} wiz_NetInfo;
+
+void reg_wizchip_device_handle(void* gen_device_h);
+void reg_wizchip_cris_cbfunc(void (*cris_en)(void), void (*cris_ex)(void));
+void reg_wizchip_cs_cbfunc(void (*cs_sel)(void), void (*cs_desel)(void));
+void reg_wizchip_spiburst_cbfunc(void (*spi_rb)(uint8_t* pBuf, uint16_t len), void (*spi_wb)(uint8_t* pBuf, uint16_t len));
+void reg_wizchip_spi_write_then_read_cbfunc(void (*spi_wtr)(uint8_t* pTx, uint8_t tx_len, uint8_t* pRx, uint8_t rx_len));
+
+int8_t wizchip_init(uint8_t* txsize, uint8_t* rxsize);
+void wizchip_setnetinfo(wiz_NetInfo* pnetinfo);
+void wizchip_getnetinfo(wiz_NetInfo* pnetinfo);
+void wizchip_setinterruptmask(intr_kind intr);
+void wizchip_clrinterrupt(intr_kind intr);
+
+#endif /* HOST_WIZCHIP_CONF_H_ */
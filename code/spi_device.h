@@ -16,6 +16,7 @@ extern "C" {
 #include "generic_bus_device.h"
 #include "spi.h"
 #include "dma.h"
+#include "spi_devices.h"
 
 
 #ifdef OOP_USE_RTOS
@@ -57,7 +58,7 @@ protected:
 
 	explicit SPIDevice(spi_device_id_t spi_device_id);
 
-	~SPIDevice() = default;;
+	~SPIDevice() { SPI_DMA_Free(dma_buffer); }
 
 	// (Re-)Configure SPI before use
 	void configureSPI(const SPIConfig&);
@@ -67,7 +68,7 @@ protected:
 	void deselect(void);
 
 
-	// Read/Write
+	// Read/Write, each one frame under the bus lock, polled or DMA by the polled threshold (see setPolledThreshold())
 	/**
 	 * \brief Reads variable length of Data from SPI into a buffer
 	 *
@@ -136,7 +137,184 @@ protected:
 	 */
 	HAL_StatusTypeDef writeWhileRead(uint8_t* tx_buffer, uint8_t* rx_buffer, uint16_t len);
 
+	/**
+	 * \brief Executes a list of segments back-to-back under one bus lock.
+	 * Chip-Select is handled per segment (see spi_segment_t),
+	 * spi_cs_state is the state that selects the device.
+	 *
+	 * @param[in] segments transaction list
+	 * @param[in] count number of segments
+	 * @returns HAL-Status of the first failing segment or HAL_OK
+	 */
+	HAL_StatusTypeDef transfer(const spi_segment_t* segments, uint8_t count);
+
+	/**
+	 * \brief Scatter-gather: writes all tx spans, then reads into all rx spans
+	 * in one CS frame, DMA is re-armed between the spans (see spi_iovec_t).
+	 *
+	 * @param[in] tx_iov spans to write, e.g. command header and payload
+	 * @param[in] tx_count number of tx spans
+	 * @param[in] rx_iov spans to read into, may be nullptr
+	 * @param[in] rx_count number of rx spans
+	 * @returns HAL-Status of the first failing span or HAL_OK
+	 */
+	HAL_StatusTypeDef writeThenReadV(const spi_iovec_t* tx_iov, uint8_t tx_count, const spi_iovec_t* rx_iov = nullptr, uint8_t rx_count = 0);
+	HAL_StatusTypeDef writeV(const spi_iovec_t* iov, uint8_t count) { return writeThenReadV(iov, count); }
+	HAL_StatusTypeDef readV(const spi_iovec_t* iov, uint8_t count) { return writeThenReadV(nullptr, 0, iov, count); }
+
+	/**
+	 * \brief Starts a transfer and returns without waiting for it.
+	 * The bus stays locked and the device selected until the transfer finished,
+	 * then on_complete runs in the SPI Task of the bus with the HAL-Status
+	 * (see spi_async_t). Buffers and the record must stay valid until then.
+	 *
+	 * @param[in,out] transfer caller-owned record, must not be pending
+	 * @param[in] tx_buffer nullptr: receive only
+	 * @param[out] rx_buffer nullptr: transmit only
+	 * @param[in] len length of the data to be written/read
+	 * @param[in] on_complete completion callback, may be nullptr
+	 * @param[in] context passed to on_complete
+	 * @returns HAL-Status of the start, on_complete is only called if HAL_OK
+	 */
+	HAL_StatusTypeDef transferAsync(spi_async_t& transfer, const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t len,
+			fp_spi_async_complete on_complete, void* context = nullptr);
+
+	/**
+	 * \brief DMA-safe buffer owned by the device, taken from the SPI_DMA_Alloc() pool on
+	 * first use and returned when the device is destroyed. It is cache line aligned, so
+	 * DMA receives into it without a bounce copy; other buffers are cleaned, invalidated
+	 * or bounced automatically by transfer(), Transaction and transferAsync().
+	 *
+	 * @param[in] len needed length, up to SPI_DMA_POOL_SIZE
+	 * @returns buffer or nullptr if len is too long or the pool is exhausted
+	 */
+	uint8_t* dmaBuffer(uint32_t len);
+
+	/**
+	 * \brief Transfers shorter than the threshold are polled, longer ones use DMA.
+	 *
+	 * @param[in] threshold length in bytes, 0: always DMA
+	 */
+	void setPolledThreshold(uint16_t threshold) { polled_threshold = threshold; }
+
+	/**
+	 * \brief Polls every transfer whatever its length, transferAsync() included
+	 * (it completes before returning). For devices without DMA streams.
+	 *
+	 * @param[in] polled_only false: the polled threshold decides
+	 */
+	void setPolledOnly(bool polled_only) { spi_polled_only = polled_only; }
+
+	/**
+	 * \brief Deadline margin and retries of the hung transfer recovery.
+	 * A transfer not finished within its wire time plus timeout_ms is aborted,
+	 * the bus resynchronised and the transaction list repeated up to retries times.
+	 *
+	 * @param[in] timeout_ms deadline margin, 0: SPI_DEADLINE_DEFAULT_MS
+	 * @param[in] retries 0 (default): fail on the first error, more only if every
+	 *            transaction of the device is safe to repeat
+	 */
+	void setRecovery(uint16_t timeout_ms, uint8_t retries) { recovery_timeout_ms = timeout_ms; recovery_retries = retries; }
+
+	/**
+	 * \brief Replaces the HAL_GPIO_WritePin() of the bus layer for Chip-Select by a
+	 * single BSRR store, e.g. of words known at compile time (see StaticSPIDevice).
+	 *
+	 * @param[in] select_bsrr stored to the port's BSRR to select, 0: GPIO HAL
+	 * @param[in] idle_bsrr stored to the port's BSRR to deselect, 0: GPIO HAL
+	 */
+	void setChipSelect(uint32_t select_bsrr, uint32_t idle_bsrr) { spi_cs_bsrr_select = select_bsrr; spi_cs_bsrr_idle = idle_bsrr; }
+
+	/**
+	 * \brief Settings the bus layer loads after taking the bus lock, unless the bus
+	 * is already in them. Another device or a stream tick may have reprogrammed the
+	 * bus between configureSPI() and the transfer.
+	 *
+	 * @param[in] settings must stay valid while set, nullptr: keep the bus as it is
+	 */
+	void setBusSettings(const spi_settings_t* settings) { spi_bus_settings = settings; }
+
+	/**
+	 * \brief Measures polled and DMA transfers on the bus at the bus settings
+	 * (see setBusSettings(), loaded under the bus lock) or else at the current
+	 * configuration and sets the threshold where DMA starts to win.
+	 * Call from a task after configureSPI().
+	 *
+	 * @returns the new threshold
+	 */
+	uint16_t calibratePolledThreshold(void);
+
+	/**
+	 * \brief Counters of this device (see spi_device_stats_t), copied consistently.
+	 */
+	void getStats(spi_device_stats_t& copy) const { SPI_Stats_Get(&stats, &copy); }
+	void resetStats(void) { SPI_Stats_Reset(&stats); }
+
+	/**
+	 * \brief Lists the device in SPI_Stats_GetDevice() and the Ethernet statistics dump.
+	 *
+	 * @param[in] id identifier shown in the dump
+	 * @returns false if SPI_STATS_MAX_DEVICES are registered already
+	 */
+	bool registerStats(uint32_t id) { return SPI_Stats_Register(&stats, spi_instance, id); }
+
+	/**
+	 * \brief Holds the bus lock and Chip-Select from construction to destruction,
+	 * so several transfers form one CS frame without other devices in between.
+	 * After a failed transfer CS is released and the following ones are skipped.
+	 *
+	 * \code
+	 * {
+	 *   Transaction t(*this);
+	 *   t.write(header, sizeof(header));
+	 *   t.read(payload, len);
+	 * }
+	 * \endcode
+	 */
+	class Transaction {
+	public:
+		explicit Transaction(SPIDevice& device);
+		~Transaction() { SPI_Bus_Release(&guard); }
+
+		Transaction(const Transaction&) = delete;
+		Transaction& operator=(const Transaction&) = delete;
+
+		HAL_StatusTypeDef write(const uint8_t* tx_buffer, uint32_t len) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_Write(&guard, tx_buffer, len));
+		}
+		HAL_StatusTypeDef read(uint8_t* rx_buffer, uint32_t len) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_Read(&guard, rx_buffer, len));
+		}
+		HAL_StatusTypeDef writeWhileRead(const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t len) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_WriteRead(&guard, tx_buffer, rx_buffer, len));
+		}
+		HAL_StatusTypeDef writeV(const spi_iovec_t* iov, uint8_t count) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_WriteV(&guard, iov, count));
+		}
+		HAL_StatusTypeDef readV(const spi_iovec_t* iov, uint8_t count) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_ReadV(&guard, iov, count));
+		}
+		// One list for all spans, a retry repeats the whole call
+		HAL_StatusTypeDef writeThenReadV(const spi_iovec_t* tx_iov, uint8_t tx_count, const spi_iovec_t* rx_iov, uint8_t rx_count) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_WriteThenReadV(&guard, tx_iov, tx_count, rx_iov, rx_count));
+		}
+		// Segments without keep_cs end the CS frame, the next transfer selects again
+		HAL_StatusTypeDef transfer(const spi_segment_t* segments, uint8_t count) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Guard_Transfer(&guard, segments, count));
+		}
+
+		// Ends the transaction early, returns the first failing HAL-Status or HAL_OK
+		HAL_StatusTypeDef release(void) {
+			return static_cast<HAL_StatusTypeDef>(SPI_Bus_Release(&guard));
+		}
+
+	private:
+		spi_bus_guard_t guard;
+	};
+
 private:
+	spi_target_t target(void);
+
 	// Variables
 	SPI_HandleTypeDef*  spi_handle;
 	SPI_TypeDef *       spi_instance;
@@ -147,6 +325,15 @@ private:
 	DMA_HandleTypeDef* 	dma_tx_handle;
 
 	uint32_t            pclk_freq;
+	uint16_t            polled_threshold = SPI_POLLED_THRESHOLD_DEFAULT;
+	spi_device_stats_t  stats = {};
+	uint16_t            recovery_timeout_ms = SPI_DEADLINE_DEFAULT_MS;
+	uint8_t             recovery_retries = SPI_RETRY_DEFAULT;
+	uint8_t*            dma_buffer = nullptr;
+	uint32_t            spi_cs_bsrr_select = 0;
+	uint32_t            spi_cs_bsrr_idle = 0;
+	const spi_settings_t* spi_bus_settings = nullptr;
+	bool                spi_polled_only = false;
 };
 
 #ifdef __cplusplus
@@ -10,6 +10,7 @@
 
 #include "spi.h"
 #include "gpio.h"
+#include "spi_devices.h"
 
 
 // Simplified device ID enum - only what is actually used
@@ -25,64 +26,79 @@ enum SPIDeviceID {
 using spi_device_id_t = SPIDeviceID;
 
 // Single configuration struct instead of multiple arrays
+// Peripherals are stored as base addresses so the table can be constexpr. The prescaler itself
+// is derived when the bus loads the device settings (spi_bus_load()), the table only
+// calculates the effective rate for the build-time report below.
 typedef struct {
-    SPI_TypeDef* spi_instance;
-    GPIO_TypeDef* cs_port;
+    uintptr_t spi_base;
+    uintptr_t cs_port_base;
     uint16_t cs_pin;
     GPIO_PinState cs_active_state;  // Some devices use active high, others low
-    uint32_t baudrate = 0;
+    uint32_t baudrate = 0;          // Requested, 0: SPI_BAUDRATEPRESCALER_16
+    uint32_t baudrate_effective = 0; // Derived, see spi_device_config()
+    bool use_dma = true;            // false: every transfer polled (see StaticSPIDevice)
+
+    SPI_TypeDef* spi_instance() const { return reinterpret_cast<SPI_TypeDef*>(spi_base); }
+    GPIO_TypeDef* cs_port() const { return reinterpret_cast<GPIO_TypeDef*>(cs_port_base); }
+    constexpr bool baudrate_met() const { return baudrate == 0 || baudrate_effective == baudrate; }
 } spi_device_config_t;
 
+// SPI1, SPI4, SPI5 and SPI6 are APB2 peripherals, SPI2 and SPI3 sit on APB1
+constexpr uint32_t spi_pclk_hz(uintptr_t spi_base) {
+    return (spi_base >= APB2PERIPH_BASE) ? SPI_PCLK2_HZ : SPI_PCLK1_HZ;
+}
+
+constexpr spi_device_config_t spi_device_config(uintptr_t spi_base, uintptr_t cs_port_base, uint16_t cs_pin,
+                                                GPIO_PinState cs_active_state, uint32_t baudrate = 0,
+                                                bool use_dma = true) {
+    return {
+        spi_base, cs_port_base, cs_pin, cs_active_state, baudrate,
+        (baudrate != 0) ? SPI_BAUDRATE_EFFECTIVE(spi_pclk_hz(spi_base), baudrate)
+                        : spi_pclk_hz(spi_base) >> ((SPI_BAUDRATEPRESCALER_16 >> SPI_CR1_BR_Pos) + 1),
+        use_dma
+    };
+}
+
 // Single configuration table - much cleaner than multiple arrays
-static const spi_device_config_t spi_device_configs[SPI_DEVICE_COUNT] = {
+static constexpr spi_device_config_t spi_device_configs[SPI_DEVICE_COUNT] = {
     // SPI_IO_MCP23S08
-    {
-        .spi_instance = SPI1,
-        .cs_port = GPIOI,
-        .cs_pin = GPIO_PIN_1,
-        .cs_active_state = GPIO_PIN_RESET,
-				.baudrate = 10000000 // 10 MHz
-    },
+    spi_device_config(SPI1_BASE, GPIOI_BASE, GPIO_PIN_1, GPIO_PIN_RESET, 10000000), // 10 MHz
     // SPI_ADC_AD7324
-    {
-        .spi_instance = SPI1,
-        .cs_port = GPIOI,
-        .cs_pin = GPIO_PIN_4,
-        .cs_active_state = GPIO_PIN_RESET,
-				.baudrate = 10000000 // 10 MHz
-    },
+    spi_device_config(SPI1_BASE, GPIOI_BASE, GPIO_PIN_4, GPIO_PIN_RESET, 10000000), // 10 MHz
     // SPI_DAC_AD5724
-    {
-        .spi_instance = SPI1,
-        .cs_port = GPIOI,
-        .cs_pin = GPIO_PIN_5,
-        .cs_active_state = GPIO_PIN_RESET,
-				.baudrate = 10000000 // 10 MHz
-    },
+    spi_device_config(SPI1_BASE, GPIOI_BASE, GPIO_PIN_5, GPIO_PIN_RESET, 10000000), // 10 MHz
     // SPI_ETH_W5500
-    {
-        .spi_instance = SPI2,
-        .cs_port = GPIOH,
-        .cs_pin = GPIO_PIN_3,
-        .cs_active_state = GPIO_PIN_RESET,
-				.baudrate = 25000000 // 25 MHz
-    },
+    spi_device_config(SPI2_BASE, GPIOH_BASE, GPIO_PIN_3, GPIO_PIN_RESET, 25000000), // 25 MHz
     // SPI_ADDON1
-    {
-        .spi_instance = SPI2,
-        .cs_port = GPIOH,
-        .cs_pin = GPIO_PIN_3,
-        .cs_active_state = GPIO_PIN_RESET
-    },
+    spi_device_config(SPI2_BASE, GPIOH_BASE, GPIO_PIN_3, GPIO_PIN_RESET),
     // SPI_ADDON2
-    {
-        .spi_instance = SPI2,
-        .cs_port = GPIOA,
-        .cs_pin = GPIO_PIN_2,
-        .cs_active_state = GPIO_PIN_RESET
-    }
+    spi_device_config(SPI2_BASE, GPIOA_BASE, GPIO_PIN_2, GPIO_PIN_RESET)
+};
+
+// Build-time report of the bus speeds: every device whose requested rate can't be met
+// triggers a deprecation warning naming the device, the requested and the effective rate, e.g.
+// "'... spi_baudrate_report<...>::check() [with Id = SPI_ETH_W5500; Requested = 25000000;
+//  Effective = 13500000]' is deprecated"
+template<spi_device_id_t Id, uint32_t Requested, uint32_t Effective, bool Met>
+struct spi_baudrate_report {
+    static constexpr bool check() { return true; }
+};
+
+template<spi_device_id_t Id, uint32_t Requested, uint32_t Effective>
+struct spi_baudrate_report<Id, Requested, Effective, false> {
+    [[deprecated("SPI baud rate not reachable with SPI_PCLK1_HZ/SPI_PCLK2_HZ, the device runs at the effective rate")]]
+    static constexpr bool check() { return true; }
 };
 
+#define SPI_DEVICE_BAUDRATE_REPORT(id) \
+    static_assert(spi_baudrate_report<id, spi_device_configs[id].baudrate, \
+        spi_device_configs[id].baudrate_effective, spi_device_configs[id].baudrate_met()>::check(), "")
 
+SPI_DEVICE_BAUDRATE_REPORT(SPI_IO_MCP23S08);
+SPI_DEVICE_BAUDRATE_REPORT(SPI_ADC_AD7324);
+SPI_DEVICE_BAUDRATE_REPORT(SPI_DAC_AD5724);
+SPI_DEVICE_BAUDRATE_REPORT(SPI_ETH_W5500);
+SPI_DEVICE_BAUDRATE_REPORT(SPI_ADDON1);
+SPI_DEVICE_BAUDRATE_REPORT(SPI_ADDON2);
 
 #endif /* INC_SPI_DEVICE_CONFIG_H_ */
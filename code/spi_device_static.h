@@ -0,0 +1,79 @@
+/*
+ * spi_device_static.h
+ *
+ *  SPIDevice bound to an entry of spi_device_configs[] at compile time.
+ *  Bus, pin and polarity are constants, so Chip-Select is a single BSRR store
+ *  and the polarity and DMA/polled decisions are resolved by the compiler.
+ */
+
+#ifndef INC_SPI_DEVICE_STATIC_H_
+#define INC_SPI_DEVICE_STATIC_H_
+
+#include "spi_device.h"
+#include "spi_device_config.h"
+
+
+/**
+ * \brief SPIDevice of a fixed table entry, base class for the device drivers:
+ *
+ * \code
+ * class W5500 : public StaticSPIDevice<SPI_ETH_W5500> { ... };
+ * class AD7324 : public StaticSPIDevice<SPI_ADC_AD7324> { ... };
+ * \endcode
+ *
+ * The bus layer (transfer(), Transaction, transferAsync()) selects the device
+ * by storing cs_select_bsrr/cs_idle_bsrr instead of HAL_GPIO_WritePin().
+ * select()/deselect() hide the ones of SPIDevice for drivers that frame by hand.
+ *
+ * @tparam Id entry of spi_device_configs[]
+ * @tparam UseDMA false: every transfer is polled, the bus never waits for DMA/IT,
+ *         defaults to the use_dma of the entry
+ */
+template<spi_device_id_t Id, bool UseDMA = spi_device_configs[Id].use_dma>
+class StaticSPIDevice : public SPIDevice {
+public:
+	static_assert(Id < SPI_DEVICE_COUNT, "no entry in spi_device_configs[]");
+	static constexpr spi_device_config_t config = spi_device_configs[Id];
+
+	static_assert(config.cs_pin != 0 && (config.cs_pin & (config.cs_pin - 1)) == 0,
+			"Chip-Select must be a single pin");
+
+	// BSRR: the low half sets pins, the high half resets them
+	static constexpr uint32_t cs_select_bsrr = (config.cs_active_state == GPIO_PIN_SET)
+			? uint32_t(config.cs_pin) : uint32_t(config.cs_pin) << 16;
+	static constexpr uint32_t cs_idle_bsrr = (config.cs_active_state == GPIO_PIN_SET)
+			? uint32_t(config.cs_pin) << 16 : uint32_t(config.cs_pin);
+
+	static void csWrite(bool select) {
+#ifdef SPI_HOST_BUILD
+		// No GPIO registers on the host, the device models see the pin through the HAL
+		GPIO_PinState cs_idle = (config.cs_active_state == GPIO_PIN_SET) ? GPIO_PIN_RESET : GPIO_PIN_SET;
+		HAL_GPIO_WritePin(config.cs_port(), config.cs_pin, select ? config.cs_active_state : cs_idle);
+#else
+		config.cs_port()->BSRR = select ? cs_select_bsrr : cs_idle_bsrr;
+#endif
+	}
+
+protected:
+	StaticSPIDevice() : SPIDevice(Id) {
+		setChipSelect(cs_select_bsrr, cs_idle_bsrr);
+		SPIDevice::setPolledOnly(!UseDMA);
+	}
+
+	void select(void) { csWrite(true); }
+	void deselect(void) { csWrite(false); }
+
+	// Only DMA devices choose between polled and DMA transfers
+	void setPolledThreshold(uint16_t threshold) {
+		if(UseDMA) SPIDevice::setPolledThreshold(threshold);
+	}
+	void setPolledOnly(bool polled_only) {
+		SPIDevice::setPolledOnly(polled_only || !UseDMA);
+	}
+	uint16_t calibratePolledThreshold(void) {
+		static_assert(UseDMA, "polled device, nothing to calibrate");
+		return SPIDevice::calibratePolledThreshold();
+	}
+};
+
+#endif /* INC_SPI_DEVICE_STATIC_H_ */
@@ -0,0 +1,119 @@
+/*
+ * spi_device_transfer.cpp
+ *
+ *  Read/write, transaction lists, scatter-gather, bus transaction guards, asynchronous transfers,
+ *  the DMA buffer and the polled/DMA threshold for SPIDevice, executed by the shared bus implementation
+ *  in spi_devices.c so C and C++ devices use the same bus lock.
+ */
+
+#include "spi_device.h"
+
+spi_target_t SPIDevice::target(void)
+{
+	return spi_target_t {
+			spi_handle,
+			spi_cs_port,
+			spi_cs_pin,
+			spi_cs_state,
+			polled_threshold,
+			&stats,
+			recovery_timeout_ms,
+			recovery_retries,
+			spi_cs_bsrr_select,
+			spi_cs_bsrr_idle,
+			spi_bus_settings,
+			spi_polled_only,
+	};
+}
+
+HAL_StatusTypeDef SPIDevice::transfer(const spi_segment_t* segments, uint8_t count)
+{
+	spi_target_t device_target = target();
+
+	return static_cast<HAL_StatusTypeDef>(SPI_Bus_Transfer(&device_target, segments, count));
+}
+
+HAL_StatusTypeDef SPIDevice::read(uint8_t* rx_buffer, uint16_t len)
+{
+	spi_segment_t segment = { nullptr, rx_buffer, len, false, 0 };
+
+	return transfer(&segment, 1);
+}
+
+HAL_StatusTypeDef SPIDevice::write(uint8_t* tx_buffer, uint16_t len)
+{
+	spi_segment_t segment = { tx_buffer, nullptr, len, false, 0 };
+
+	return transfer(&segment, 1);
+}
+
+#ifdef OOP_USE_RTOS
+// The bus layer waits for the completion itself, the semaphore is not needed anymore
+HAL_StatusTypeDef SPIDevice::read(uint8_t* rx_buffer, uint16_t len, osSemaphoreId_t sempahore)
+{
+	(void) sempahore;
+	return read(rx_buffer, len);
+}
+
+HAL_StatusTypeDef SPIDevice::write(uint8_t* tx_buffer, uint16_t len, osSemaphoreId_t sempahore)
+{
+	(void) sempahore;
+	return write(tx_buffer, len);
+}
+#endif
+
+HAL_StatusTypeDef SPIDevice::writeThenRead(uint8_t* tx_buffer, uint16_t tx_len, uint8_t* rx_buffer, uint16_t rx_len)
+{
+	spi_segment_t segments[2] = {
+			{ tx_buffer, nullptr, tx_len, true, 0 },
+			{ nullptr, rx_buffer, rx_len, false, 0 },
+	};
+
+	return transfer(segments, 2);
+}
+
+HAL_StatusTypeDef SPIDevice::writeWhileRead(uint8_t* tx_buffer, uint8_t* rx_buffer, uint16_t len)
+{
+	spi_segment_t segment = { tx_buffer, rx_buffer, len, false, 0 };
+
+	return transfer(&segment, 1);
+}
+
+HAL_StatusTypeDef SPIDevice::writeThenReadV(const spi_iovec_t* tx_iov, uint8_t tx_count, const spi_iovec_t* rx_iov, uint8_t rx_count)
+{
+	Transaction transaction(*this);
+
+	transaction.writeThenReadV(tx_iov, tx_count, rx_iov, rx_count);
+	return transaction.release();
+}
+
+HAL_StatusTypeDef SPIDevice::transferAsync(spi_async_t& transfer, const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t len,
+		fp_spi_async_complete on_complete, void* context)
+{
+	spi_target_t device_target = target();
+
+	return static_cast<HAL_StatusTypeDef>(
+			SPI_Bus_TransferAsync(&transfer, &device_target, tx_buffer, rx_buffer, len, on_complete, context));
+}
+
+SPIDevice::Transaction::Transaction(SPIDevice& device)
+{
+	spi_target_t device_target = device.target();
+
+	SPI_Bus_Acquire(&guard, &device_target);
+}
+
+uint8_t* SPIDevice::dmaBuffer(uint32_t len)
+{
+	if(len > SPI_DMA_POOL_SIZE) return nullptr;
+
+	// Always a whole pool buffer, so later calls up to SPI_DMA_POOL_SIZE get the same one
+	if(dma_buffer == nullptr) dma_buffer = static_cast<uint8_t*>(SPI_DMA_Alloc(SPI_DMA_POOL_SIZE));
+	return dma_buffer;
+}
+
+uint16_t SPIDevice::calibratePolledThreshold(void)
+{
+	polled_threshold = SPI_Bus_CalibratePolledThreshold(spi_handle, spi_bus_settings);
+	return polled_threshold;
+}
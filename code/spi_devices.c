@@ -7,8 +7,13 @@
 
 
 #include "spi_devices.h"
+#include "spi_task.h"
 #include "spi.h"
 #include "stdbool.h"
+#include "string.h"
+#ifdef SPI_HOST_BUILD
+#include <time.h>
+#endif
 
 // Helper Functions
 static inline bool spi_clk_is_plck1(SPI_TypeDef *spi_inst) {
@@ -19,18 +24,227 @@ static inline bool spi_clk_is_plck1(SPI_TypeDef *spi_inst) {
   return false;
 }
 
-static inline uint8_t get_spi_index(SPI_TypeDef *spi_inst) {
-  if (spi_inst == SPI1) return 0;
-  if (spi_inst == SPI2) return 1;
-  if (spi_inst == SPI3) return 2;
-  if (spi_inst == SPI4) return 3;
-  if (spi_inst == SPI5) return 4;
-  if (spi_inst == SPI6) return 5;
-  return -1; // error
+// SPI Semaphores
+static osSemaphoreId semaphores[SPI_BUS_COUNT];
+
+// Completion of a DMA/IT transfer or abort a task waits for, given by the completion interrupts.
+// Only the holder gives the bus lock back, so a task waiting for the bus can't take it mid-transaction
+static osSemaphoreId completions[SPI_BUS_COUNT];
+
+// spi_bus_resync() waits for its abort, a transfer completing in between doesn't wake it
+static volatile bool bus_aborting[SPI_BUS_COUNT];
+
+// Settings currently loaded into each bus, devices sharing a bus only re-init on change
+static spi_settings_t active_settings[SPI_BUS_COUNT];
+static bool active_settings_valid[SPI_BUS_COUNT];
+
+// Busy cycles per slot of the utilisation window
+typedef struct __SPI_Bus_Util_TypeDef
+{
+  uint32_t    busy_cycles[SPI_UTIL_SLOTS];
+  TickType_t  slot_start;
+  uint8_t     slot;
+}spi_bus_util_t;
+
+#define SPI_UTIL_SLOT_TICKS  pdMS_TO_TICKS(SPI_UTIL_WINDOW_MS / SPI_UTIL_SLOTS)
+
+typedef struct __SPI_Stats_Entry_TypeDef
+{
+  spi_device_stats_t* stats;
+  SPI_TypeDef*        spi_inst;
+  uint32_t            id;
+}spi_stats_entry_t;
+
+static spi_bus_util_t bus_util[SPI_BUS_COUNT];
+static spi_stats_entry_t stats_entries[SPI_STATS_MAX_DEVICES];
+
+// Asynchronous transfer in flight per bus, finished by the completion interrupt
+static spi_async_t* volatile async_transfers[SPI_BUS_COUNT];
+
+// Finished asynchronous transfers whose on_complete couldn't be queued, newest first
+static spi_async_t* volatile async_late[SPI_BUS_COUNT];
+
+// Streaming acquisition per bus, its scans are continued by the completion interrupts
+static spi_stream_t* volatile streams[SPI_BUS_COUNT];
+
+// DMA receive in flight per bus, finished by spi_dma_finish()
+typedef struct __SPI_DMA_Rx_TypeDef
+{
+  uint8_t*    dst;      // Caller's buffer
+  uint8_t*    bounce;   // Pool buffer the DMA writes to instead, NULL: straight into dst
+  uint32_t    len;      // 0: nothing in flight
+}spi_dma_rx_t;
+
+static spi_dma_rx_t dma_rx[SPI_BUS_COUNT];
+
+// DMA-safe buffers, a set bit in dma_pool_free marks a free one
+static uint8_t dma_pool[SPI_DMA_POOL_COUNT][SPI_DMA_POOL_SIZE] __ALIGNED(SPI_DCACHE_LINE);
+static uint32_t dma_pool_free = (SPI_DMA_POOL_COUNT >= 32) ? 0xFFFFFFFFU : ((1UL << SPI_DMA_POOL_COUNT) - 1U);
+
+// Before starting a transfer to wait for: a completion left over from an aborted one must not end the wait
+static inline void spi_bus_arm(uint8_t spi_idx) {
+  if(spi_idx < SPI_BUS_COUNT && completions[spi_idx] != NULL) SPI_TakeSemaphoreTimeout(completions[spi_idx], 0);
 }
 
-// SPI Semaphores
-static osSemaphoreId semaphores[6];
+static inline osStatus spi_bus_wait(uint8_t spi_idx, uint32_t millisec) {
+  if(spi_idx >= SPI_BUS_COUNT || completions[spi_idx] == NULL) return osErrorParameter;
+  return SPI_TakeSemaphoreTimeout(completions[spi_idx], millisec);
+}
+
+static inline void spi_target_cs(const spi_target_t* target, bool select);
+static HAL_StatusTypeDef spi_segment_polled(SPI_HandleTypeDef* spi_h, const spi_segment_t* seg, uint16_t timeout_ms);
+static HAL_StatusTypeDef spi_chunk_start(SPI_HandleTypeDef* spi_h, const spi_segment_t* chunk);
+static spi_segment_t spi_segment_chunk(const spi_segment_t* seg, uint32_t offset);
+static spi_segment_t spi_segment_dma_chunk(const spi_segment_t* seg, uint32_t offset);
+static HAL_StatusTypeDef spi_chunk_polled(SPI_HandleTypeDef* spi_h, const spi_segment_t* chunk, uint16_t timeout_ms);
+static void spi_stream_complete(spi_stream_t* stream, uint8_t spi_idx, uint8_t status);
+static void spi_dma_finish(uint8_t spi_idx, bool copy);
+static void spi_bus_recover(SPI_HandleTypeDef* spi_h, bool blocking, spi_device_stats_t* stats, uint8_t status);
+
+#ifdef SPI_HOST_BUILD
+void SPI_CycleCounterInit(void)
+{
+}
+
+uint32_t SPI_GetCycles(void)
+{
+  struct timespec now;
+
+  // Same unit as on target: core clock cycles, wrapping at 32 bit
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t) ((uint64_t) now.tv_sec * SystemCoreClock +
+                     (uint64_t) now.tv_nsec * (SystemCoreClock / 1000000U) / 1000U);
+}
+#else
+void SPI_CycleCounterInit(void)
+{
+  // Enable trace and the free running cycle counter, safe to call more than once
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+#endif
+
+// Busy wait on the cycle counter, used between segments of a transaction list
+static void spi_delay_us(uint16_t delay_us) {
+  uint32_t start = SPI_GetCycles();
+  uint32_t cycles = (uint32_t) delay_us * (SystemCoreClock / 1000000U);
+
+  while((SPI_GetCycles() - start) < cycles);
+}
+
+osSemaphoreId SPI_GetBusSemaphore(SPI_TypeDef* spi_inst)
+{
+  uint8_t spi_idx = get_spi_index(spi_inst);
+
+  if(spi_idx >= SPI_BUS_COUNT) return NULL;
+  return semaphores[spi_idx];
+}
+
+// Before the scheduler runs there is nothing to race with, a critical section
+// would leave the interrupts masked until the scheduler starts
+static inline void spi_stats_enter(void) {
+  if(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) taskENTER_CRITICAL();
+}
+
+static inline void spi_stats_exit(void) {
+  if(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) taskEXIT_CRITICAL();
+}
+
+// Moves the window forward to now, slots that passed are cleared
+static void spi_bus_util_advance(spi_bus_util_t* util, TickType_t now) {
+  TickType_t passed = (now - util->slot_start) / SPI_UTIL_SLOT_TICKS;
+
+  if(passed == 0) return;
+  for(TickType_t i = 0; i < passed && i < SPI_UTIL_SLOTS; i++) {
+    util->slot = (util->slot + 1) % SPI_UTIL_SLOTS;
+    util->busy_cycles[util->slot] = 0;
+  }
+  util->slot_start += passed * SPI_UTIL_SLOT_TICKS;
+}
+
+// Accounts a finished transfer to the bus and the device, task context
+static void spi_stats_account(SPI_HandleTypeDef* spi_h, spi_device_stats_t* stats, uint32_t len, uint32_t cycles, bool failed) {
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
+  TickType_t now = xTaskGetTickCount();
+
+  spi_stats_enter();
+  if(spi_idx < SPI_BUS_COUNT) {
+    spi_bus_util_advance(&bus_util[spi_idx], now);
+    bus_util[spi_idx].busy_cycles[bus_util[spi_idx].slot] += cycles;
+  }
+  if(stats != NULL) {
+    stats->bytes += len;
+    stats->wire_cycles += cycles;
+    if(failed) stats->errors++;
+  }
+  spi_stats_exit();
+}
+
+static void spi_stats_acquired(spi_device_stats_t* stats, uint32_t wait_cycles) {
+  if(stats == NULL) return;
+
+  spi_stats_enter();
+  stats->transactions++;
+  stats->wait_cycles += wait_cycles;
+  spi_stats_exit();
+}
+
+void SPI_Stats_Get(const spi_device_stats_t* stats, spi_device_stats_t* copy)
+{
+  spi_stats_enter();
+  *copy = *stats;
+  spi_stats_exit();
+}
+
+void SPI_Stats_Reset(spi_device_stats_t* stats)
+{
+  spi_stats_enter();
+  memset(stats, 0, sizeof(spi_device_stats_t));
+  spi_stats_exit();
+}
+
+bool SPI_Stats_Register(spi_device_stats_t* stats, SPI_TypeDef* spi_inst, uint32_t id)
+{
+  for(uint8_t i = 0; i < SPI_STATS_MAX_DEVICES; i++) {
+    if(stats_entries[i].stats == stats || stats_entries[i].stats == NULL) {
+      stats_entries[i].spi_inst = spi_inst;
+      stats_entries[i].id = id;
+      stats_entries[i].stats = stats;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SPI_Stats_GetDevice(uint8_t index, spi_device_stats_t* copy, SPI_TypeDef** spi_inst, uint32_t* id)
+{
+  if(index >= SPI_STATS_MAX_DEVICES || stats_entries[index].stats == NULL) return false;
+
+  SPI_Stats_Get(stats_entries[index].stats, copy);
+  if(spi_inst != NULL) *spi_inst = stats_entries[index].spi_inst;
+  if(id != NULL) *id = stats_entries[index].id;
+  return true;
+}
+
+uint16_t SPI_Bus_GetUtilisation(SPI_TypeDef* spi_inst)
+{
+  uint8_t spi_idx = get_spi_index(spi_inst);
+  uint64_t busy = 0, window;
+  TickType_t now = xTaskGetTickCount();
+
+  if(spi_idx >= SPI_BUS_COUNT) return 0;
+
+  spi_stats_enter();
+  spi_bus_util_advance(&bus_util[spi_idx], now);
+  for(uint8_t i = 0; i < SPI_UTIL_SLOTS; i++) busy += bus_util[spi_idx].busy_cycles[i];
+  // Full slots plus the elapsed part of the current one
+  window = (uint64_t) ((SPI_UTIL_SLOTS - 1) * SPI_UTIL_SLOT_TICKS + (now - bus_util[spi_idx].slot_start)) *
+           (SystemCoreClock / configTICK_RATE_HZ);
+  spi_stats_exit();
+
+  if(window == 0) return 0;
+  return (busy >= window) ? 1000 : (uint16_t) (busy * 1000U / window);
+}
 
 void SPI_DeviceBusInit(spi_device_t* spi_device)
 {
@@ -39,6 +253,7 @@ void SPI_DeviceBusInit(spi_device_t* spi_device)
   SPI_TypeDef *  spi_inst = spi_device->spi_instance;
   // Init SPI
   spi_device->spi_h = SPI_Init(spi_inst);
+  SPI_Bus_InvalidateConfig(spi_inst);
 
   //Init Chip Select SPI  (low active)
   GPIO_Init_struct.Pin = spi_device->spi_cs_pin;
@@ -54,6 +269,12 @@ void SPI_DeviceBusInit(spi_device_t* spi_device)
   spi_device->device_write_then_read = SPI_Device_WriteThenRead;
   spi_device->device_write_while_read = SPI_Device_WriteWhileRead;
   spi_device->config_spi = SPI_Device_ConfigSPI;
+  spi_device->device_transfer = SPI_Device_Transfer;
+  spi_device->device_write_v = SPI_Device_WriteV;
+  spi_device->device_read_v = SPI_Device_ReadV;
+  spi_device->polled_threshold = SPI_POLLED_THRESHOLD_DEFAULT;
+  spi_device->timeout_ms = SPI_DEADLINE_DEFAULT_MS;
+  spi_device->retries = SPI_RETRY_DEFAULT;
 
   // Static semaphore Init || Needs to be changed when SPI3 and further is used
   uint8_t spi_idx = get_spi_index(spi_device->spi_instance);
@@ -62,24 +283,45 @@ void SPI_DeviceBusInit(spi_device_t* spi_device)
     osSemaphoreDef(temp_sem);
     semaphores[spi_idx] = osSemaphoreCreate(osSemaphore(temp_sem), 1);
   }
+  if(completions[spi_idx] == NULL) {
+    osSemaphoreDef(done_sem);
+    completions[spi_idx] = osSemaphoreCreate(osSemaphore(done_sem), 1);
+    // Created available, nothing has completed yet
+    SPI_TakeSemaphoreTimeout(completions[spi_idx], 0);
+  }
   spi_device->semaphore_id = semaphores[spi_idx];
+
+  SPI_Stats_Register(&spi_device->stats, spi_inst, (uint32_t) spi_device->bus_device_id);
 }
 
-uint8_t SPI_Device_ConfigSPI(void* device_h)
+void SPI_Bus_InvalidateConfig(SPI_TypeDef* spi_inst)
 {
-  spi_device_t* device = (spi_device_t*) device_h;
+  uint8_t spi_idx = get_spi_index(spi_inst);
+
+  if(spi_idx < SPI_BUS_COUNT) active_settings_valid[spi_idx] = false;
+}
+
+static inline bool spi_bus_loaded(uint8_t spi_idx, const spi_settings_t* settings) {
+  return spi_idx < SPI_BUS_COUNT && active_settings_valid[spi_idx] &&
+         memcmp(&active_settings[spi_idx], settings, sizeof(spi_settings_t)) == 0;
+}
+
+// Loads the settings into the bus, no RTOS calls: also used from interrupt context by the stream
+static HAL_StatusTypeDef spi_bus_load(SPI_HandleTypeDef* spi_h, const spi_settings_t* settings) {
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
+  HAL_StatusTypeDef ret;
 
-  device->spi_h->Init.DataSize = device->spi_settings.DataSize;
-  device->spi_h->Init.CLKPolarity = device->spi_settings.CLKPolarity;
-  device->spi_h->Init.CLKPhase = device->spi_settings.CLKPhase;
-  device->spi_h->Init.FirstBit = device->spi_settings.FirstBit;
+  spi_h->Init.DataSize = settings->DataSize;
+  spi_h->Init.CLKPolarity = settings->CLKPolarity;
+  spi_h->Init.CLKPhase = settings->CLKPhase;
+  spi_h->Init.FirstBit = settings->FirstBit;
 
   // Overwrite BaudRatePrescaler Value if target baud rate is set
-  if(device->spi_settings.BaudRate !=  0) {
+  if(settings->BaudRate !=  0) {
     uint32_t spi_clock_hz;
 
     // Determine SPI clock frequency based on SPI instance
-    if(spi_clk_is_plck1(device->spi_instance))
+    if(spi_clk_is_plck1(spi_h->Instance))
     {
       spi_clock_hz = HAL_RCC_GetPCLK2Freq(); // APB2 clock
     }
@@ -88,45 +330,219 @@ uint8_t SPI_Device_ConfigSPI(void* device_h)
       spi_clock_hz = HAL_RCC_GetPCLK1Freq(); // APB1 clock
     }
 
-    uint32_t prescaler_value = (spi_clock_hz + device->spi_settings.BaudRate - 1) / device->spi_settings.BaudRate;
+    // Fastest prescaler (2 to 256) not exceeding the requested rate, same as the compile-time tables
+    spi_h->Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_FOR(spi_clock_hz, settings->BaudRate);
+  }
+  else {
+    spi_h->Init.BaudRatePrescaler = settings->BaudRatePrescaler;
+  }
 
-    // Find the power of 2: 2^n where n is between 1 and 8 (prescaler 2 to 256)
-    uint32_t power = 1; // Start at 2^1 = 2
-    while ((1U << power) < prescaler_value && power < 8) {
-      power++;
-    }
+  ret = HAL_SPI_Init(spi_h);
 
-    // Convert to HAL constant: power=1 maps to 0, power=2 maps to 1, etc.
-    device->spi_h->Init.BaudRatePrescaler = (power - 1) << SPI_CR1_BR_Pos;
+  if(spi_idx < SPI_BUS_COUNT) {
+    active_settings[spi_idx] = *settings;
+    active_settings_valid[spi_idx] = (ret == HAL_OK);
   }
-  else {
-    device->spi_h->Init.BaudRatePrescaler = device->spi_settings.BaudRatePrescaler;
+
+  return ret;
+}
+
+uint8_t SPI_Device_ConfigSPI(void* device_h)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+  uint8_t ret;
+
+  // Bus is already in this mode, skip prescaler calculation and HAL_SPI_Init
+  if(spi_bus_loaded(get_spi_index(device->spi_instance), &device->spi_settings)) {
+    return HAL_OK;
+  }
+
+  ret = spi_bus_load(device->spi_h, &device->spi_settings);
+
+  spi_stats_enter();
+  device->stats.reconfigs++;
+  spi_stats_exit();
+
+  return ret;
+}
+
+// Settings for spi_target_t, NULL if the device was never configured (there is no DataSize 0)
+static inline const spi_settings_t* spi_device_settings(spi_device_t* device) {
+  return (device->spi_settings.DataSize != 0) ? &device->spi_settings : NULL;
+}
+
+// Loads the target's settings unless the bus is already in them, the caller holds the bus lock
+static HAL_StatusTypeDef spi_target_load(const spi_target_t* target) {
+  HAL_StatusTypeDef ret;
+
+  if(target->settings == NULL || spi_bus_loaded(get_spi_index(target->spi_h->Instance), target->settings)) {
+    return HAL_OK;
+  }
+
+  ret = spi_bus_load(target->spi_h, target->settings);
+
+  if(target->stats != NULL) {
+    spi_stats_enter();
+    target->stats->reconfigs++;
+    spi_stats_exit();
+  }
+  return ret;
+}
+
+// Runs in the SPI Task of the bus, queued by spi_bus_complete()
+static void spi_async_complete_CB(void* Handle) {
+  spi_async_t* transfer = (spi_async_t*) Handle;
+  fp_spi_async_complete on_complete = transfer->on_complete;
+  void* context = transfer->context;
+  uint8_t status = transfer->status;
+
+  spi_stats_account(transfer->target.spi_h, transfer->target.stats, transfer->len,
+                    transfer->end_cycles - transfer->start_cycles, status != HAL_OK);
+
+  // The record may be restarted from within on_complete
+  transfer->pending = false;
+  if(on_complete != NULL) on_complete(transfer, status, context);
+}
+
+// Interrupt or task context: keeps a finished transfer for SPI_Bus_RunLateCompletions() when the SPI Task's queues are full
+static void spi_async_late(uint8_t spi_idx, spi_async_t* transfer) {
+  UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+
+  transfer->late_next = async_late[spi_idx];
+  async_late[spi_idx] = transfer;
+  if(transfer->target.stats != NULL) transfer->target.stats->late++;
+  taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+}
+
+/**
+ * Runs the on_complete of asynchronous transfers that finished while the ISR ring or the
+ * urgent lane of the bus was full, in the order they finished. Called by the SPI Task of
+ * the bus after draining its queues, the ring had room again by then.
+ * @param spi_idx bus index (see get_spi_index())
+ */
+void SPI_Bus_RunLateCompletions(uint8_t spi_idx)
+{
+  spi_async_t* late;
+  spi_async_t* ordered = NULL;
+
+  if(spi_idx >= SPI_BUS_COUNT || async_late[spi_idx] == NULL) return;
+
+  taskENTER_CRITICAL();
+  late = async_late[spi_idx];
+  async_late[spi_idx] = NULL;
+  taskEXIT_CRITICAL();
+
+  while(late != NULL) {
+    spi_async_t* next = late->late_next;
+
+    late->late_next = ordered;
+    ordered = late;
+    late = next;
+  }
+
+  // on_complete may restart the record, which may end up in the list again
+  while(ordered != NULL) {
+    spi_async_t* next = ordered->late_next;
+
+    spi_async_complete_CB(ordered);
+    ordered = next;
+  }
+}
+
+// Interrupt context: finishes an asynchronous transfer or wakes the task waiting in SPI_Guard_Transfer()/spi_bus_resync()
+static void spi_bus_complete(SPI_HandleTypeDef *hspi, uint8_t status) {
+  uint8_t spi_idx = get_spi_index(hspi->Instance);
+  spi_async_t* transfer;
+  spi_stream_t* stream;
+
+  if(spi_idx >= SPI_BUS_COUNT) return;
+
+  // Received data is visible to the CPU from here on
+  spi_dma_finish(spi_idx, status == HAL_OK);
+
+  // A scan holds the bus lock until its last conversion frame
+  stream = streams[spi_idx];
+  if(stream != NULL && stream->busy) {
+    spi_stream_complete(stream, spi_idx, status);
+    return;
+  }
+
+  transfer = async_transfers[spi_idx];
+  if(transfer != NULL && status == HAL_OK && transfer->remaining != 0) {
+    spi_segment_t rest = { .tx = transfer->tx, .rx = transfer->rx, .len = transfer->remaining };
+    spi_segment_t chunk = spi_segment_dma_chunk(&rest, 0);
+
+    // Next chunk under the same CS, the bus stays locked
+    transfer->tx = (chunk.tx != NULL) ? chunk.tx + chunk.len : NULL;
+    transfer->rx = (chunk.rx != NULL) ? chunk.rx + chunk.len : NULL;
+    transfer->remaining -= chunk.len;
+    if(spi_chunk_start(hspi, &chunk) == HAL_OK) return;
+    status = HAL_ERROR;
   }
 
-  return HAL_SPI_Init(device->spi_h);
+  if(transfer != NULL) {
+    async_transfers[spi_idx] = NULL;
+    transfer->end_cycles = SPI_GetCycles();
+    transfer->status = status;
+    spi_target_cs(&transfer->target, false);
+
+    // Ring full: the SPI Task runs the callback after draining it
+    if(SPI_Executor_QueueRequest_fromISR(SPI_Task_GetExecutorByIndex(spi_idx), spi_async_complete_CB,
+                                         transfer, SPI_PRIO_URGENT) != SPI_REQUEST_OK) {
+      spi_async_late(spi_idx, transfer);
+    }
+    SPI_GiveSemaphore(semaphores[spi_idx]);
+    return;
+  }
+
+  // While aborting only the abort's own completion (HAL_TIMEOUT) counts
+  if(bus_aborting[spi_idx] && status != HAL_TIMEOUT) return;
+  if(completions[spi_idx] != NULL) SPI_GiveSemaphore(completions[spi_idx]);
 }
 
 // Override __weak HAL-Functions for Interrupt based SPI Communication
 void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
-  SPI_GiveSemaphore(semaphores[get_spi_index(hspi->Instance)]);
+  spi_bus_complete(hspi, HAL_OK);
 }
 
 
 void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
-  SPI_GiveSemaphore(semaphores[get_spi_index(hspi->Instance)]);
-  // TODO: Implement
+  spi_bus_complete(hspi, HAL_OK);
 }
 
 
 void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
-  SPI_GiveSemaphore(semaphores[get_spi_index(hspi->Instance)]);
-  // TODO: Implement
+  spi_bus_complete(hspi, HAL_OK);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  spi_bus_complete(hspi, HAL_ERROR);
+}
+
+// Wakes the task waiting in spi_bus_resync()
+void HAL_SPI_AbortCpltCallback(SPI_HandleTypeDef *hspi) {
+  spi_bus_complete(hspi, HAL_TIMEOUT);
+}
+
+__weak void SPI_Bus_RecoveryCallback(SPI_HandleTypeDef *hspi, uint8_t status) {
+  UNUSED(hspi);
+  UNUSED(status);
 }
 
-void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
-void HAL_SPI_AbortCpltCallback(SPI_HandleTypeDef *hspi);
 
 
+// Blocking transfer without bus lock, counted like a guarded one
+static HAL_StatusTypeDef spi_device_polled(spi_device_t* device, const spi_segment_t* seg) {
+  uint32_t start = SPI_GetCycles();
+  HAL_StatusTypeDef ret = spi_segment_polled(device->spi_h, seg, device->timeout_ms);
+
+  if(ret != HAL_OK) spi_bus_recover(device->spi_h, true, &device->stats, ret);
+
+  spi_stats_acquired(&device->stats, 0);
+  spi_stats_account(device->spi_h, &device->stats, seg->len, SPI_GetCycles() - start, ret != HAL_OK);
+  return ret;
+}
+
 /**
  *
  * @param device_h
@@ -138,7 +554,7 @@ void HAL_SPI_AbortCpltCallback(SPI_HandleTypeDef *hspi);
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceRead(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceRead(void* device_h, uint8_t* RX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
   uint8_t ret = 0;
@@ -146,7 +562,9 @@ uint8_t SPI_DeviceRead(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
   // activate chip-select
   spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
 
-  HAL_SPI_Receive(device->spi_h, RX_buffer, data_count, 1000); // read
+  spi_segment_t segment = { .rx = RX_buffer, .len = data_count };
+
+  ret = spi_device_polled(device, &segment); // read
 
   // deactivate chip-select
   spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
@@ -165,29 +583,12 @@ uint8_t SPI_DeviceRead(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceRead_async(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceRead_async(void* device_h, uint8_t* RX_buffer, uint32_t data_count)
 {
-  spi_device_t* device = (spi_device_t*) device_h;
-  uint8_t ret = 0;
-
-  SPI_TakeSemaphore(device->semaphore_id);
-
-  // activate chip-select
-  spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
-
-  if(device->spi_h->hdmarx == NULL || device->spi_h->hdmatx == NULL) {
-    ret = HAL_SPI_Receive_IT(device->spi_h, RX_buffer, data_count); // read
-  }
-  else {
-    ret = HAL_SPI_Receive_DMA(device->spi_h, RX_buffer, data_count); // read
-  }
-
-  SPI_GiveTakeSemaphore(device->semaphore_id);
+  spi_segment_t segment = { .rx = RX_buffer, .len = data_count };
 
-  // deactivate chip-select
-  spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
-
-  return ret;
+  // Polled or DMA/IT depending on the device's polled_threshold
+  return SPI_Device_Transfer(device_h, &segment, 1);
 }
 
 /**
@@ -201,14 +602,15 @@ uint8_t SPI_DeviceRead_async(void* device_h, uint8_t* RX_buffer, uint8_t data_co
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceRead_NoCS(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceRead_NoCS(void* device_h, uint8_t* RX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
   device->config_spi(device);
 
   uint8_t ret = 0;
   //spi_device_t* device_h = GetSPIDeviceHandleFromID(ID);
-  if(HAL_SPI_Receive(device->spi_h, RX_buffer, data_count, 1000) != HAL_OK) {
+  spi_segment_t segment = { .rx = RX_buffer, .len = data_count };
+  if(spi_device_polled(device, &segment) != HAL_OK) {
     return HAL_ERROR;
   };
 
@@ -226,26 +628,16 @@ uint8_t SPI_DeviceRead_NoCS(void* device_h, uint8_t* RX_buffer, uint8_t data_cou
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceRead_NoCS_async(void* device_h, uint8_t* RX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceRead_NoCS_async(void* device_h, uint8_t* RX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
-  device->config_spi(device);
-
-  SPI_TakeSemaphore(device->semaphore_id);
-
-  uint8_t ret = 0;
-  //spi_device_t* device_h = GetSPIDeviceHandleFromID(ID);
-
-  if(device->spi_h->hdmarx != NULL && device->spi_h->hdmatx != NULL) {
-    ret = (uint8_t) HAL_SPI_Receive_DMA(device->spi_h, RX_buffer, data_count);
-  }
-  else {
-    ret = (uint8_t) HAL_SPI_Receive_IT(device->spi_h,RX_buffer,data_count);
-  }
-
-  SPI_GiveTakeSemaphore(device->semaphore_id);
+  // No CS port: Chip-Select is left to the caller
+  spi_target_t target = { .spi_h = device->spi_h, .polled_threshold = device->polled_threshold,
+                          .stats = &device->stats, .timeout_ms = device->timeout_ms, .retries = device->retries,
+                          .settings = spi_device_settings(device) };
+  spi_segment_t segment = { .rx = RX_buffer, .len = data_count };
 
-  return ret;
+  return SPI_Bus_Transfer(&target, &segment, 1);
 }
 
 /**
@@ -259,7 +651,7 @@ uint8_t SPI_DeviceRead_NoCS_async(void* device_h, uint8_t* RX_buffer, uint8_t da
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceWrite(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceWrite(void* device_h, uint8_t* TX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
   uint8_t ret = 0;
@@ -267,9 +659,9 @@ uint8_t SPI_DeviceWrite(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
   // activate Chip-Select
   spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
 
-  if(HAL_SPI_Transmit(device->spi_h, TX_buffer, data_count, 1000) != HAL_OK) {
-    return HAL_ERROR;
-  }
+  spi_segment_t segment = { .tx = TX_buffer, .len = data_count };
+
+  ret = spi_device_polled(device, &segment);
 
   // deactivate Chip-Select
   spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
@@ -288,29 +680,12 @@ uint8_t SPI_DeviceWrite(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceWrite_async(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceWrite_async(void* device_h, uint8_t* TX_buffer, uint32_t data_count)
 {
-  spi_device_t* device = (spi_device_t*) device_h;
-  uint8_t ret = 0;
-
-  SPI_TakeSemaphore(device->semaphore_id);
-
-  // activate Chip-Select
-  spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
-
-  if(device->spi_h->hdmarx == NULL || device->spi_h->hdmatx == NULL) {
-    ret = HAL_SPI_Transmit_IT(device->spi_h, TX_buffer, data_count);  // write
-  }
-  else {
-    ret = HAL_SPI_Transmit_DMA(device->spi_h, TX_buffer, data_count); // write
-  }
+  spi_segment_t segment = { .tx = TX_buffer, .len = data_count };
 
-  SPI_GiveTakeSemaphore(device->semaphore_id);
-
-  // deactivate Chip-Select
-  spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
-
-  return ret;
+  // Polled or DMA/IT depending on the device's polled_threshold
+  return SPI_Device_Transfer(device_h, &segment, 1);
 }
 
 /**
@@ -324,13 +699,14 @@ uint8_t SPI_DeviceWrite_async(void* device_h, uint8_t* TX_buffer, uint8_t data_c
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceWrite_NoCS(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceWrite_NoCS(void* device_h, uint8_t* TX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
   device->config_spi(device);
 
   uint8_t ret = 0;
-  if(HAL_SPI_Transmit(device->spi_h, TX_buffer, data_count, 1000) != HAL_OK) {
+  spi_segment_t segment = { .tx = TX_buffer, .len = data_count };
+  if(spi_device_polled(device, &segment) != HAL_OK) {
     return HAL_ERROR;
   }
 
@@ -348,28 +724,25 @@ uint8_t SPI_DeviceWrite_NoCS(void* device_h, uint8_t* TX_buffer, uint8_t data_co
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_DeviceWrite_NoCS_async(void* device_h, uint8_t* TX_buffer, uint8_t data_count)
+uint8_t SPI_DeviceWrite_NoCS_async(void* device_h, uint8_t* TX_buffer, uint32_t data_count)
 {
   spi_device_t* device = (spi_device_t*) device_h;
-  device->config_spi(device);
-
-  SPI_TakeSemaphore(device->semaphore_id);
-
-  uint8_t ret = 0;
-  if(device->spi_h->hdmarx != NULL && device->spi_h->hdmatx != NULL) {
-    ret = (uint8_t) HAL_SPI_Transmit_DMA(device->spi_h, TX_buffer, data_count);
-  }
-  else {
-    ret = (uint8_t) HAL_SPI_Transmit_IT(device->spi_h,TX_buffer,data_count);
-  }
+  // No CS port: Chip-Select is left to the caller
+  spi_target_t target = { .spi_h = device->spi_h, .polled_threshold = device->polled_threshold,
+                          .stats = &device->stats, .timeout_ms = device->timeout_ms, .retries = device->retries,
+                          .settings = spi_device_settings(device) };
+  spi_segment_t segment = { .tx = TX_buffer, .len = data_count };
 
-  SPI_GiveTakeSemaphore(device->semaphore_id);
-
-  return ret;
+  return SPI_Bus_Transfer(&target, &segment, 1);
 }
 
 /**
- * write then read to device without releasing Chip-Select
+ * write then read to device without releasing Chip-Select.
+ * Frames up to SPI_WTR_FRAME_SIZE bytes go out as one full-duplex transfer
+ * (header + dummy bytes) from a DMA pool buffer, the bytes clocked in after the header
+ * are copied to rx_buffer. Longer frames, or all if the pool is exhausted, use a two
+ * segment transaction list, rx lands directly in rx_buffer.
+ * CS is held and the bus locked until the transfer completed.
  * @param device_h
  * @param tx_buffer
  * @param tx_len
@@ -381,95 +754,1067 @@ uint8_t SPI_DeviceWrite_NoCS_async(void* device_h, uint8_t* TX_buffer, uint8_t d
   HAL_BUSY     = 0x02U,
   HAL_TIMEOUT  = 0x03U
  */
-uint8_t SPI_Device_WriteThenRead(void* device_h, uint8_t* tx_buffer, uint8_t tx_len, uint8_t* rx_buffer, uint8_t rx_len)
+uint8_t SPI_Device_WriteThenRead(void* device_h, uint8_t* tx_buffer, uint32_t tx_len, uint8_t* rx_buffer, uint32_t rx_len)
 {
-  spi_device_t* device = (spi_device_t*) device_h;
-  uint8_t ret = 0;
+  uint32_t frame_len = tx_len + rx_len;
+  uint8_t* frame_tx = (frame_len <= SPI_WTR_FRAME_SIZE) ? (uint8_t*) SPI_DMA_Alloc(2 * SPI_WTR_FRAME_SIZE) : NULL;
+  uint8_t ret;
 
-  // activate Chip-Select
-  spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
+  // Not on the stack: DMA would receive into cache lines shared with other variables
+  if(frame_tx != NULL) {
+    uint8_t* frame_rx = frame_tx + SPI_WTR_FRAME_SIZE;
+    spi_segment_t frame = { .tx = frame_tx, .rx = frame_rx, .len = frame_len };
 
-  if(device->spi_h->hdmarx == NULL || device->spi_h->hdmatx == NULL) {
-    ret = HAL_SPI_Transmit_IT(device->spi_h, tx_buffer, tx_len); // write
-    ret = HAL_SPI_Receive_IT(device->spi_h, rx_buffer, rx_len);  // read
-  }
-  else{
-    ret = HAL_SPI_Transmit_DMA(device->spi_h, tx_buffer, tx_len); // write
-    ret = HAL_SPI_Receive_DMA(device->spi_h, rx_buffer, rx_len);  // read
+    memcpy(frame_tx, tx_buffer, tx_len);
+    memset(&frame_tx[tx_len], SPI_WTR_DUMMY_BYTE, rx_len);
+
+    ret = SPI_Device_Transfer(device_h, &frame, 1);
+    if(ret == HAL_OK) {
+      memcpy(rx_buffer, &frame_rx[tx_len], rx_len);
+    }
+    SPI_DMA_Free(frame_tx);
   }
+  else {
+    spi_segment_t segments[2] = {
+        { .tx = tx_buffer, .len = tx_len, .keep_cs = true },
+        { .rx = rx_buffer, .len = rx_len },
+    };
 
-  // deactivate Chip-Select
-  spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
+    ret = SPI_Device_Transfer(device_h, segments, 2);
+  }
 
   return ret;
 }
 
-uint8_t SPI_Device_WriteWhileRead(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint8_t txrx_len)
+// Blocking or DMA/IT is chosen by SPI_Bus_Transfer, both variants are the same transaction
+uint8_t SPI_Device_WriteThenRead_async(void* device_h, uint8_t* tx_buffer, uint32_t tx_len, uint8_t* rx_buffer, uint32_t rx_len)
 {
-  spi_device_t* device = (spi_device_t*) device_h;
-  uint8_t ret = 0;
+  return SPI_Device_WriteThenRead(device_h, tx_buffer, tx_len, rx_buffer, rx_len);
+}
 
-  // activate Chip-Select
-  spi_device_activate_cs(device->spi_cs_pin, device->spi_cs_port);
+uint8_t SPI_Device_WriteWhileRead(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t txrx_len)
+{
+  spi_segment_t segment = { .tx = tx_buffer, .rx = rx_buffer, .len = txrx_len };
 
-  // same time write & read
-  if(device->spi_h->hdmarx == NULL || device->spi_h->hdmatx == NULL) {
-    ret = HAL_SPI_TransmitReceive_IT(device->spi_h, tx_buffer, rx_buffer, txrx_len);
-  }
-  else {
-    ret = HAL_SPI_TransmitReceive_DMA(device->spi_h, tx_buffer, rx_buffer, txrx_len);
-  }
+  // same time write & read, CS is released after completion
+  return SPI_Device_Transfer(device_h, &segment, 1);
+}
 
-  // deactivate Chip-Select
-  spi_device_deactivate_cs(device->spi_cs_pin, device->spi_cs_port);
+// Part of a segment starting at offset that fits into one HAL transfer
+static spi_segment_t spi_segment_chunk(const spi_segment_t* seg, uint32_t offset) {
+  spi_segment_t chunk = *seg;
+  uint32_t remaining = seg->len - offset;
 
-  return ret;
+  chunk.tx = (seg->tx != NULL) ? seg->tx + offset : NULL;
+  chunk.rx = (seg->rx != NULL) ? seg->rx + offset : NULL;
+  chunk.len = (remaining > SPI_DMA_MAX_CHUNK) ? SPI_DMA_MAX_CHUNK : remaining;
+  return chunk;
 }
 
-void spi_device_activate_cs(uint16_t pin, GPIO_TypeDef* pin_port)
-{
-  // Chip-Select low active
-  HAL_GPIO_WritePin(pin_port,pin,GPIO_PIN_RESET);
+// Chunk at offset for DMA. A receive buffer too long for a pool buffer and not owning its
+// first or last cache line is cut at the line boundaries: the partial lines are bounced,
+// the whole lines in between are received in place.
+static spi_segment_t spi_segment_dma_chunk(const spi_segment_t* seg, uint32_t offset) {
+  spi_segment_t chunk = spi_segment_chunk(seg, offset);
+  uint32_t head;
+
+  if(chunk.rx == NULL || chunk.len <= SPI_DMA_POOL_SIZE || SPI_DMA_IsSafe(chunk.rx, chunk.len)) return chunk;
+
+  head = (uint32_t) (-(uintptr_t) chunk.rx & (SPI_DCACHE_LINE - 1));
+  chunk.len = (head != 0) ? head : (chunk.len & ~(uint32_t) (SPI_DCACHE_LINE - 1));
+  return chunk;
 }
 
-void spi_device_deactivate_cs(uint16_t pin, GPIO_TypeDef* pin_port)
-{
-  // Chip-Select low active
-  HAL_GPIO_WritePin(pin_port,pin,GPIO_PIN_SET);
+// Deadline of a len byte transfer: wire time at the loaded prescaler plus the margin
+static uint32_t spi_deadline_ms(SPI_HandleTypeDef* spi_h, uint32_t len, uint16_t margin_ms) {
+  uint32_t pclk = spi_clk_is_plck1(spi_h->Instance) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+  // BR = n divides PCLK by 2^(n+1)
+  uint32_t bit_rate = pclk >> (((spi_h->Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+  uint32_t wire_ms = (bit_rate == 0) ? 0 : (uint32_t) (((uint64_t) len * 8000U + bit_rate - 1) / bit_rate);
+
+  return wire_ms + ((margin_ms != 0) ? margin_ms : SPI_DEADLINE_DEFAULT_MS);
 }
 
-void SPI_TakeSemaphore(osSemaphoreId semaphore_id) {
-  // Take the Semaphore
-  volatile osStatus result = (osStatus) osSemaphoreWait(semaphore_id, SPI_RTOS_TIMEOUT_MS);
+// Polled FIFO transfer of one chunk
+static HAL_StatusTypeDef spi_chunk_polled(SPI_HandleTypeDef* spi_h, const spi_segment_t* chunk, uint16_t timeout_ms) {
+  uint16_t len = (uint16_t) chunk->len;
+  uint32_t deadline_ms = spi_deadline_ms(spi_h, chunk->len, timeout_ms);
 
-  // TODO Error Handling
-  if(result != osOK) {
-    return;
+  if(chunk->tx != NULL && chunk->rx != NULL) {
+    return HAL_SPI_TransmitReceive(spi_h, (uint8_t*) chunk->tx, chunk->rx, len, deadline_ms);
   }
+  else if(chunk->tx != NULL) {
+    return HAL_SPI_Transmit(spi_h, (uint8_t*) chunk->tx, len, deadline_ms);
+  }
+  return HAL_SPI_Receive(spi_h, chunk->rx, len, deadline_ms);
 }
 
-void SPI_GiveSemaphore(osSemaphoreId semaphore_id) {
-  // Release the Semaphore
-  volatile osStatus result = osSemaphoreRelease(semaphore_id);
+// Polled transfer of a whole segment, chunk after chunk
+static HAL_StatusTypeDef spi_segment_polled(SPI_HandleTypeDef* spi_h, const spi_segment_t* seg, uint16_t timeout_ms) {
+  HAL_StatusTypeDef ret = HAL_OK;
 
-  if (result != osOK){
-    // TODO Error Handling
-    return;
+  for(uint32_t offset = 0; offset < seg->len && ret == HAL_OK; offset += SPI_DMA_MAX_CHUNK) {
+    spi_segment_t chunk = spi_segment_chunk(seg, offset);
+    ret = spi_chunk_polled(spi_h, &chunk, timeout_ms);
   }
+  return ret;
 }
 
-// Used to make sure async transactions don't deselect CS before completion.
-void SPI_GiveTakeSemaphore(osSemaphoreId semaphore_id) {
-  // Take the Semaphore
-  volatile osStatus result = (osStatus) osSemaphoreWait(semaphore_id, SPI_RTOS_TIMEOUT_MS);
+/**
+ * Stops whatever runs on the bus and reloads its configuration, the caller holds the bus lock.
+ * HAL_SPI_Abort_IT() completes through HAL_SPI_AbortCpltCallback(), if that doesn't happen
+ * in time (or without scheduler) the blocking abort is used.
+ */
+static void spi_bus_resync(SPI_HandleTypeDef* spi_h, bool blocking) {
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
 
-  if(result != osOK) {
-    // TODO Error Handling
-    return;
+  if(blocking || spi_idx >= SPI_BUS_COUNT) {
+    HAL_SPI_Abort(spi_h);
   }
-
-  // Release the Semaphore
-  result = osSemaphoreRelease(semaphore_id);
+  else {
+    spi_bus_arm(spi_idx);
+    bus_aborting[spi_idx] = true;
+    if(HAL_SPI_Abort_IT(spi_h) != HAL_OK || spi_bus_wait(spi_idx, SPI_ABORT_TIMEOUT_MS) != osOK) {
+      HAL_SPI_Abort(spi_h);
+    }
+    bus_aborting[spi_idx] = false;
+  }
+
+  if(spi_idx < SPI_BUS_COUNT) spi_dma_finish(spi_idx, false);
+
+  // Init still holds the settings of the last transfer
+  if(HAL_SPI_Init(spi_h) != HAL_OK) SPI_Bus_InvalidateConfig(spi_h->Instance);
+}
+
+static void spi_bus_recover(SPI_HandleTypeDef* spi_h, bool blocking, spi_device_stats_t* stats, uint8_t status) {
+  spi_bus_resync(spi_h, blocking);
+
+  if(stats != NULL && status == HAL_TIMEOUT) {
+    spi_stats_enter();
+    stats->timeouts++;
+    spi_stats_exit();
+  }
+  SPI_Bus_RecoveryCallback(spi_h, status);
+}
+
+// Data cache maintenance (Cortex-M7), lines are SPI_DCACHE_LINE bytes
+#if defined(__DCACHE_PRESENT) && (__DCACHE_PRESENT == 1U) && !defined(SPI_HOST_BUILD)
+static inline bool spi_dcache_enabled(void) {
+  return (SCB->CCR & SCB_CCR_DC_Msk) != 0;
+}
+
+// Whole lines covering [addr, addr + len)
+static inline void spi_dcache_clean(const void* addr, uint32_t len) {
+  uintptr_t start = (uintptr_t) addr & ~(uintptr_t) (SPI_DCACHE_LINE - 1);
+
+  SCB_CleanDCache_by_Addr((uint32_t*) start, (int32_t) ((uintptr_t) addr + len - start));
+}
+
+// Only for line aligned buffers, partial lines would lose the neighbours' dirty data
+static inline void spi_dcache_invalidate(void* addr, uint32_t len) {
+  SCB_InvalidateDCache_by_Addr((uint32_t*) addr, (int32_t) len);
+}
+#else
+static inline bool spi_dcache_enabled(void) { return false; }
+static inline void spi_dcache_clean(const void* addr, uint32_t len) { UNUSED(addr); UNUSED(len); }
+static inline void spi_dcache_invalidate(void* addr, uint32_t len) { UNUSED(addr); UNUSED(len); }
+#endif
+
+/**
+ * Takes a buffer from the DMA pool, usable from interrupt context.
+ * The buffer starts on a cache line and its lines belong to it alone, so DMA
+ * can receive into it directly. Return it with SPI_DMA_Free().
+ * @param len up to SPI_DMA_POOL_SIZE
+ * @return buffer or NULL if the pool is exhausted or len too long
+ */
+void* SPI_DMA_Alloc(uint32_t len)
+{
+  uint32_t free_mask = __atomic_load_n(&dma_pool_free, __ATOMIC_ACQUIRE);
+
+  if(len == 0 || len > SPI_DMA_POOL_SIZE) return NULL;
+
+  while(free_mask != 0) {
+    uint32_t index = (uint32_t) __builtin_ctz(free_mask);
+
+    if(__atomic_compare_exchange_n(&dma_pool_free, &free_mask, free_mask & ~(1UL << index),
+                                   false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return dma_pool[index];
+    }
+  }
+  return NULL;
+}
+
+void SPI_DMA_Free(void* buffer)
+{
+  uintptr_t offset = (uintptr_t) buffer - (uintptr_t) dma_pool;
+
+  if(buffer == NULL || offset >= sizeof(dma_pool)) return;
+  __atomic_fetch_or(&dma_pool_free, 1UL << (offset / SPI_DMA_POOL_SIZE), __ATOMIC_RELEASE);
+}
+
+/**
+ * DMA may receive into the buffer without a bounce: cache off, whole lines, or a line
+ * aligned span of a pool buffer (the rest of its last line is the owner's padding).
+ */
+bool SPI_DMA_IsSafe(const void* buffer, uint32_t len)
+{
+  uintptr_t offset = (uintptr_t) buffer - (uintptr_t) dma_pool;
+
+  if(!spi_dcache_enabled()) return true;
+  if(((uintptr_t) buffer % SPI_DCACHE_LINE) != 0) return false;
+  if(offset < sizeof(dma_pool)) return (offset % SPI_DMA_POOL_SIZE) + len <= SPI_DMA_POOL_SIZE;
+  return (len % SPI_DCACHE_LINE) == 0;
+}
+
+/**
+ * Cache maintenance before a DMA chunk: the transmit data is cleaned to memory,
+ * the receive buffer invalidated so no dirty line is evicted over the DMA data.
+ * A receive buffer that doesn't own its cache lines is replaced by a pool buffer.
+ * @param rx in: caller's receive buffer, out: the one to hand to the DMA
+ * @return false: no pool buffer was free, the chunk has to use IT
+ */
+static bool spi_dma_prepare(uint8_t spi_idx, const spi_segment_t* chunk, uint8_t** rx) {
+  spi_dma_rx_t* record = &dma_rx[spi_idx];
+
+  if(!spi_dcache_enabled()) return true;
+
+  if(chunk->tx != NULL) spi_dcache_clean(chunk->tx, chunk->len);
+  if(chunk->rx == NULL) return true;
+
+  record->dst = chunk->rx;
+  record->bounce = NULL;
+  if(!SPI_DMA_IsSafe(chunk->rx, chunk->len)) {
+    record->bounce = (uint8_t*) SPI_DMA_Alloc(chunk->len);
+    if(record->bounce == NULL) return false;
+    *rx = record->bounce;
+  }
+
+  spi_dcache_invalidate(*rx, (chunk->len + SPI_DCACHE_LINE - 1) & ~(uint32_t) (SPI_DCACHE_LINE - 1));
+  record->len = chunk->len;
+  return true;
+}
+
+/**
+ * After a DMA chunk (or its abort): invalidates the lines speculative reads may have
+ * loaded meanwhile and copies a bounce buffer to the caller's buffer.
+ * @param copy false: the data is dropped (error, abort)
+ */
+static void spi_dma_finish(uint8_t spi_idx, bool copy) {
+  spi_dma_rx_t* record = &dma_rx[spi_idx];
+  uint8_t* buffer = (record->bounce != NULL) ? record->bounce : record->dst;
+
+  if(record->len == 0) return;
+
+  spi_dcache_invalidate(buffer, (record->len + SPI_DCACHE_LINE - 1) & ~(uint32_t) (SPI_DCACHE_LINE - 1));
+  if(record->bounce != NULL) {
+    if(copy) memcpy(record->dst, record->bounce, record->len);
+    SPI_DMA_Free(record->bounce);
+    record->bounce = NULL;
+  }
+  record->len = 0;
+}
+
+// Starts a DMA (or IT without DMA streams) transfer of one chunk, the completion callback gives the bus semaphore
+static HAL_StatusTypeDef spi_chunk_start(SPI_HandleTypeDef* spi_h, const spi_segment_t* chunk) {
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
+  bool use_dma = spi_h->hdmarx != NULL && spi_h->hdmatx != NULL;
+  uint16_t len = (uint16_t) chunk->len;
+  uint8_t* rx = chunk->rx;
+  HAL_StatusTypeDef ret;
+
+  if(use_dma && spi_idx < SPI_BUS_COUNT) use_dma = spi_dma_prepare(spi_idx, chunk, &rx);
+
+  if(chunk->tx != NULL && chunk->rx != NULL) {
+    ret = use_dma ? HAL_SPI_TransmitReceive_DMA(spi_h, (uint8_t*) chunk->tx, rx, len)
+                  : HAL_SPI_TransmitReceive_IT(spi_h, (uint8_t*) chunk->tx, chunk->rx, len);
+  }
+  else if(chunk->tx != NULL) {
+    ret = use_dma ? HAL_SPI_Transmit_DMA(spi_h, (uint8_t*) chunk->tx, len)
+                  : HAL_SPI_Transmit_IT(spi_h, (uint8_t*) chunk->tx, len);
+  }
+  else {
+    ret = use_dma ? HAL_SPI_Receive_DMA(spi_h, rx, len)
+                  : HAL_SPI_Receive_IT(spi_h, chunk->rx, len);
+  }
+
+  if(ret != HAL_OK && spi_idx < SPI_BUS_COUNT) spi_dma_finish(spi_idx, false);
+  return ret;
+}
+
+static inline void spi_target_cs(const spi_target_t* target, bool select) {
+  GPIO_PinState cs_idle = (target->cs_active == GPIO_PIN_RESET) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+
+  // No port: bus cycles without a device selected (calibration)
+  if(target->cs_port == NULL) return;
+#ifndef SPI_HOST_BUILD
+  // One store, the pin and polarity are already in the word
+  uint32_t bsrr = select ? target->cs_bsrr_select : target->cs_bsrr_idle;
+  if(bsrr != 0) {
+    target->cs_port->BSRR = bsrr;
+    return;
+  }
+#endif
+  HAL_GPIO_WritePin(target->cs_port, target->cs_pin, select ? target->cs_active : cs_idle);
+}
+
+// Aborts an asynchronous transfer past its deadline, its bus lock passes to the caller
+static bool spi_async_expire(uint8_t spi_idx, spi_async_t* transfer) {
+  bool expired;
+
+  taskENTER_CRITICAL();
+  expired = async_transfers[spi_idx] == transfer && (int32_t) (xTaskGetTickCount() - transfer->deadline) >= 0;
+  if(expired) async_transfers[spi_idx] = NULL;
+  taskEXIT_CRITICAL();
+
+  if(!expired) return false;
+
+  transfer->end_cycles = SPI_GetCycles();
+  transfer->status = HAL_TIMEOUT;
+  spi_target_cs(&transfer->target, false);
+  spi_bus_recover(transfer->target.spi_h, false, transfer->target.stats, HAL_TIMEOUT);
+
+  // Task context: the ISR ring belongs to the interrupts
+  if(SPI_Executor_QueueRequest(SPI_Task_GetExecutorByIndex(spi_idx), spi_async_complete_CB,
+                               transfer, SPI_PRIO_URGENT) != SPI_REQUEST_OK) {
+    spi_async_late(spi_idx, transfer);
+  }
+  return true;
+}
+
+/**
+ * Aborts the asynchronous transfer in flight on the bus once it is past its deadline, so it
+ * finishes with HAL_TIMEOUT even if no other task waits for the bus. Called by the SPI Task
+ * of the bus every time it wakes up.
+ * @param spi_idx bus index (see get_spi_index())
+ * @return ticks until the deadline of the transfer in flight, portMAX_DELAY if there is none
+ */
+TickType_t SPI_Bus_ExpireAsync(uint8_t spi_idx)
+{
+  spi_async_t* transfer;
+  int32_t left;
+
+  if(spi_idx >= SPI_BUS_COUNT) return portMAX_DELAY;
+  transfer = async_transfers[spi_idx];
+  if(transfer == NULL) return portMAX_DELAY;
+
+  if(spi_async_expire(spi_idx, transfer)) {
+    // The bus lock passed to this task, nobody waits to use it
+    SPI_GiveSemaphore(semaphores[spi_idx]);
+    return portMAX_DELAY;
+  }
+
+  // The transfer may have finished in between, then this is just a short wait
+  left = (int32_t) (transfer->deadline - xTaskGetTickCount());
+  return (left > 0) ? (TickType_t) left : 0;
+}
+
+// Takes the bus lock within SPI_RTOS_TIMEOUT_MS, a hung asynchronous transfer is aborted at its deadline
+static osStatus spi_bus_lock(SPI_HandleTypeDef* spi_h, osSemaphoreId semaphore_id) {
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(SPI_RTOS_TIMEOUT_MS);
+
+  while(1) {
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    TickType_t wait = (elapsed < timeout) ? timeout - elapsed : 0;
+    spi_async_t* transfer = (spi_idx < SPI_BUS_COUNT) ? async_transfers[spi_idx] : NULL;
+
+    if(transfer != NULL) {
+      int32_t left = (int32_t) (transfer->deadline - xTaskGetTickCount());
+      if(left < 0) left = 0;
+      if((TickType_t) left < wait) wait = (TickType_t) left;
+    }
+
+    if(SPI_TakeSemaphoreTimeout(semaphore_id, wait * portTICK_PERIOD_MS) == osOK ||
+       (transfer != NULL && spi_async_expire(spi_idx, transfer))) {
+      return osOK;
+    }
+    if(xTaskGetTickCount() - start >= timeout) return osErrorOS;
+  }
+}
+
+/**
+ * Locks the bus and selects the device, see spi_bus_guard_t.
+ * Before the scheduler runs (or on a bus without semaphore) there is no lock
+ * and all transfers are blocking.
+ * @param guard guard to initialise, released with SPI_Bus_Release()
+ * @param target bus handle and Chip-Select of the device
+ * @return HAL_OK or HAL_TIMEOUT if the bus wasn't free within SPI_RTOS_TIMEOUT_MS,
+ *         the guard is inactive then and only needs the (no-op) release
+ */
+uint8_t SPI_Bus_Acquire(spi_bus_guard_t* guard, const spi_target_t* target)
+{
+  guard->target = *target;
+  guard->semaphore_id = SPI_GetBusSemaphore(target->spi_h->Instance);
+  guard->blocking = guard->semaphore_id == NULL || xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED;
+  guard->status = HAL_OK;
+
+  // Other devices on the bus wait behind the guard until it is released
+  uint32_t wait_start = SPI_GetCycles();
+  if(!guard->blocking && spi_bus_lock(target->spi_h, guard->semaphore_id) != osOK) {
+    guard->status = HAL_TIMEOUT;
+    guard->selected = false;
+    guard->active = false;
+    guard->framed = false;
+    return HAL_TIMEOUT;
+  }
+  spi_stats_acquired(target->stats, SPI_GetCycles() - wait_start);
+
+  // Configured before locking, the bus may have been reprogrammed since (other device, stream tick)
+  if(spi_target_load(target) != HAL_OK) {
+    guard->status = HAL_ERROR;
+    guard->selected = false;
+    guard->active = true;
+    guard->framed = false;
+    return HAL_ERROR;
+  }
+
+  spi_target_cs(&guard->target, true);
+  guard->selected = true;
+  guard->active = true;
+  guard->framed = false;
+
+  return HAL_OK;
+}
+
+uint8_t SPI_Device_Acquire(spi_bus_guard_t* guard, void* device_h)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+  spi_target_t target = {
+      .spi_h = device->spi_h,
+      .cs_port = device->spi_cs_port,
+      .cs_pin = device->spi_cs_pin,
+      .cs_active = GPIO_PIN_RESET, // Chip-Select low active
+      .polled_threshold = device->polled_threshold,
+      .stats = &device->stats,
+      .timeout_ms = device->timeout_ms,
+      .retries = device->retries,
+      .settings = spi_device_settings(device),
+  };
+
+  return SPI_Bus_Acquire(guard, &target);
+}
+
+/**
+ * Deselects the device and unlocks the bus, safe to call more than once.
+ * @param guard
+ * @return first failing HAL status of the guarded transfers or HAL_OK
+ */
+uint8_t SPI_Bus_Release(spi_bus_guard_t* guard)
+{
+  if(!guard->active) return guard->status;
+
+  if(guard->selected) spi_target_cs(&guard->target, false);
+  guard->selected = false;
+  guard->active = false;
+
+  if(!guard->blocking) SPI_GiveSemaphore(guard->semaphore_id);
+
+  return guard->status;
+}
+
+// One pass over the list, stops at the first failing segment and resynchronises the bus
+static void spi_guard_run(spi_bus_guard_t* guard, const spi_segment_t* segments, uint8_t count) {
+  uint8_t spi_idx = get_spi_index(guard->target.spi_h->Instance);
+
+  for(uint8_t i = 0; i < count && guard->status == HAL_OK; i++) {
+    const spi_segment_t* seg = &segments[i];
+
+    if(!guard->selected) {
+      spi_target_cs(&guard->target, true);
+      guard->selected = true;
+    }
+
+    if(seg->len != 0) {
+      uint32_t start = SPI_GetCycles();
+
+      // Short transfers: DMA setup and the wake-up cost more than the transfer itself
+      if(guard->blocking || guard->target.polled_only || seg->len < guard->target.polled_threshold) {
+        guard->status = spi_segment_polled(guard->target.spi_h, seg, guard->target.timeout_ms);
+      }
+      else {
+        spi_segment_t chunk;
+
+        // Chunks follow each other under the same CS
+        for(uint32_t offset = 0; offset < seg->len && guard->status == HAL_OK; offset += chunk.len) {
+          chunk = spi_segment_dma_chunk(seg, offset);
+
+          spi_bus_arm(spi_idx);
+          guard->status = spi_chunk_start(guard->target.spi_h, &chunk);
+
+          // Wait for the completion callback, the bus lock stays with us
+          if(guard->status == HAL_OK) {
+            if(spi_bus_wait(spi_idx, spi_deadline_ms(guard->target.spi_h, chunk.len, guard->target.timeout_ms)) != osOK) {
+              guard->status = HAL_TIMEOUT;
+            }
+            else if(guard->target.spi_h->ErrorCode != HAL_SPI_ERROR_NONE) {
+              guard->status = HAL_ERROR;
+            }
+          }
+        }
+      }
+
+      spi_stats_account(guard->target.spi_h, guard->target.stats, seg->len, SPI_GetCycles() - start, guard->status != HAL_OK);
+    }
+
+    if(!seg->keep_cs || guard->status != HAL_OK) {
+      spi_target_cs(&guard->target, false);
+      guard->selected = false;
+      guard->framed = false;
+    }
+    else if(seg->len != 0) {
+      guard->framed = true;
+    }
+
+    if(guard->status != HAL_OK) {
+      spi_bus_recover(guard->target.spi_h, guard->blocking, guard->target.stats, guard->status);
+    }
+    else if(seg->delay_us != 0) {
+      spi_delay_us(seg->delay_us);
+    }
+  }
+}
+
+/**
+ * Transfers segments while the guard holds the bus. Segments without keep_cs end
+ * the CS frame, the next transfer selects the device again.
+ * Segments shorter than target->polled_threshold are polled (all of them with
+ * target->polled_only), longer ones use DMA/IT, the completion callback wakes this caller through the bus's completion semaphore.
+ * A segment failing or missing its deadline is aborted, the bus resynchronised and
+ * the list repeated from the start, up to target->retries times. Not if the call
+ * continues a CS frame an earlier call sent data in, repeating only this part would
+ * misframe the device (e.g. payload bytes parsed as a command header).
+ * After that the device is deselected and further transfers are skipped.
+ * @param guard acquired guard
+ * @param segments transaction list
+ * @param count number of segments
+ * @return
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+ */
+uint8_t SPI_Guard_Transfer(spi_bus_guard_t* guard, const spi_segment_t* segments, uint8_t count)
+{
+  uint8_t retries;
+
+  if(!guard->active) return (guard->status != HAL_OK) ? guard->status : HAL_ERROR;
+  if(guard->status != HAL_OK) return guard->status;
+
+  retries = guard->framed ? 0 : guard->target.retries;
+  spi_guard_run(guard, segments, count);
+
+  for(uint8_t retry = 0; guard->status != HAL_OK && retry < retries; retry++) {
+    if(guard->target.stats != NULL) {
+      spi_stats_enter();
+      guard->target.stats->retries++;
+      spi_stats_exit();
+    }
+    guard->status = HAL_OK;
+    spi_guard_run(guard, segments, count);
+  }
+
+  return guard->status;
+}
+
+// Single transfers inside the guard, CS stays asserted
+uint8_t SPI_Guard_Write(spi_bus_guard_t* guard, const uint8_t* tx_buffer, uint32_t len)
+{
+  spi_segment_t segment = { .tx = tx_buffer, .len = len, .keep_cs = true };
+  return SPI_Guard_Transfer(guard, &segment, 1);
+}
+
+uint8_t SPI_Guard_Read(spi_bus_guard_t* guard, uint8_t* rx_buffer, uint32_t len)
+{
+  spi_segment_t segment = { .rx = rx_buffer, .len = len, .keep_cs = true };
+  return SPI_Guard_Transfer(guard, &segment, 1);
+}
+
+uint8_t SPI_Guard_WriteRead(spi_bus_guard_t* guard, const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t len)
+{
+  spi_segment_t segment = { .tx = tx_buffer, .rx = rx_buffer, .len = len, .keep_cs = true };
+  return SPI_Guard_Transfer(guard, &segment, 1);
+}
+
+/**
+ * Scatter-gather inside the guard: the tx spans, then the rx spans as one list of
+ * keep_cs segments, polled or DMA per span depending on its length.
+ * A retry repeats all spans of the call, see SPI_Guard_Transfer().
+ * @param guard acquired guard
+ * @param tx_iov spans to write
+ * @param tx_count
+ * @param rx_iov spans to read into
+ * @param rx_count
+ * @return HAL_ERROR if there are more than SPI_IOV_MAX spans, otherwise see SPI_Guard_Transfer()
+ */
+uint8_t SPI_Guard_WriteThenReadV(spi_bus_guard_t* guard, const spi_iovec_t* tx_iov, uint8_t tx_count,
+    const spi_iovec_t* rx_iov, uint8_t rx_count)
+{
+  spi_segment_t segments[SPI_IOV_MAX];
+  uint8_t count = 0;
+
+  if(tx_count + rx_count > SPI_IOV_MAX) {
+    if(guard->active && guard->status == HAL_OK) guard->status = HAL_ERROR;
+    return (guard->status != HAL_OK) ? guard->status : HAL_ERROR;
+  }
+
+  for(uint8_t i = 0; i < tx_count; i++) {
+    segments[count++] = (spi_segment_t) { .tx = (const uint8_t*) tx_iov[i].base, .len = tx_iov[i].len, .keep_cs = true };
+  }
+  for(uint8_t i = 0; i < rx_count; i++) {
+    segments[count++] = (spi_segment_t) { .rx = (uint8_t*) rx_iov[i].base, .len = rx_iov[i].len, .keep_cs = true };
+  }
+
+  return SPI_Guard_Transfer(guard, segments, count);
+}
+
+uint8_t SPI_Guard_WriteV(spi_bus_guard_t* guard, const spi_iovec_t* iov, uint8_t count)
+{
+  return SPI_Guard_WriteThenReadV(guard, iov, count, NULL, 0);
+}
+
+uint8_t SPI_Guard_ReadV(spi_bus_guard_t* guard, const spi_iovec_t* iov, uint8_t count)
+{
+  return SPI_Guard_WriteThenReadV(guard, NULL, 0, iov, count);
+}
+
+/**
+ * Executes a transaction list under one acquisition of the bus semaphore.
+ * @param target bus handle and Chip-Select of the device
+ * @param segments transaction list
+ * @param count number of segments
+ * @return
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+ */
+uint8_t SPI_Bus_Transfer(const spi_target_t* target, const spi_segment_t* segments, uint8_t count)
+{
+  spi_bus_guard_t guard;
+
+  if(segments == NULL || count == 0) return HAL_OK;
+
+  SPI_Bus_Acquire(&guard, target);
+  SPI_Guard_Transfer(&guard, segments, count);
+  return SPI_Bus_Release(&guard);
+}
+
+/**
+ * Starts an asynchronous transfer, see spi_async_t. Waits only for the bus lock,
+ * on_complete runs in the SPI Task of the bus once the transfer finished.
+ * Before the scheduler runs and for a polled_only target the transfer is polled
+ * and on_complete is called directly.
+ * @param transfer caller-owned record, must not be pending
+ * @param target bus handle and Chip-Select of the device
+ * @param tx_buffer NULL: receive only
+ * @param rx_buffer NULL: transmit only
+ * @param len
+ * @param on_complete may be NULL
+ * @param context passed to on_complete
+ * @return status of the start, on_complete is only called if HAL_OK
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+ */
+uint8_t SPI_Bus_TransferAsync(spi_async_t* transfer, const spi_target_t* target, const uint8_t* tx_buffer, uint8_t* rx_buffer,
+    uint32_t len, fp_spi_async_complete on_complete, void* context)
+{
+  spi_segment_t segment = { .tx = tx_buffer, .rx = rx_buffer, .len = len };
+  spi_segment_t chunk = spi_segment_dma_chunk(&segment, 0);
+  uint8_t spi_idx = get_spi_index(target->spi_h->Instance);
+  osSemaphoreId semaphore_id = SPI_GetBusSemaphore(target->spi_h->Instance);
+  uint8_t ret;
+
+  if(transfer->pending || len == 0 || spi_idx >= SPI_BUS_COUNT) return HAL_ERROR;
+
+  transfer->target = *target;
+  transfer->on_complete = on_complete;
+  transfer->context = context;
+  transfer->status = HAL_OK;
+  // Chunks after the first one are started by the completion interrupt
+  transfer->tx = (chunk.tx != NULL) ? chunk.tx + chunk.len : NULL;
+  transfer->rx = (chunk.rx != NULL) ? chunk.rx + chunk.len : NULL;
+  transfer->remaining = len - chunk.len;
+  transfer->len = len;
+
+  if(semaphore_id == NULL || xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED || target->polled_only) {
+    transfer->status = SPI_Bus_Transfer(target, &segment, 1);
+    if(on_complete != NULL) on_complete(transfer, transfer->status, context);
+    return HAL_OK;
+  }
+
+  // Without an SPI Task there is no context to run on_complete in
+  if(SPI_Task_GetExecutorByIndex(spi_idx) == NULL) return HAL_ERROR;
+
+  transfer->start_cycles = SPI_GetCycles();
+  if(spi_bus_lock(target->spi_h, semaphore_id) != osOK) return HAL_TIMEOUT;
+  spi_stats_acquired(target->stats, SPI_GetCycles() - transfer->start_cycles);
+
+  if(spi_target_load(target) != HAL_OK) {
+    SPI_GiveSemaphore(semaphore_id);
+    return HAL_ERROR;
+  }
+
+  transfer->pending = true;
+  transfer->start_cycles = SPI_GetCycles();
+  transfer->deadline = xTaskGetTickCount() +
+      pdMS_TO_TICKS(spi_deadline_ms(target->spi_h, len, target->timeout_ms));
+  async_transfers[spi_idx] = transfer;
+  spi_target_cs(target, true);
+
+  ret = spi_chunk_start(target->spi_h, &chunk);
+  if(ret != HAL_OK) {
+    async_transfers[spi_idx] = NULL;
+    transfer->pending = false;
+    spi_target_cs(target, false);
+    SPI_GiveSemaphore(semaphore_id);
+  }
+
+  // The lock is released by the completion interrupt
+  return ret;
+}
+
+uint8_t SPI_Device_TransferAsync(void* device_h, spi_async_t* transfer, const uint8_t* tx_buffer, uint8_t* rx_buffer,
+    uint32_t len, fp_spi_async_complete on_complete, void* context)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+  spi_target_t target = {
+      .spi_h = device->spi_h,
+      .cs_port = device->spi_cs_port,
+      .cs_pin = device->spi_cs_pin,
+      .cs_active = GPIO_PIN_RESET, // Chip-Select low active
+      .polled_threshold = device->polled_threshold,
+      .stats = &device->stats,
+      .timeout_ms = device->timeout_ms,
+      .retries = device->retries,
+      .settings = spi_device_settings(device),
+  };
+
+  return SPI_Bus_TransferAsync(transfer, &target, tx_buffer, rx_buffer, len, on_complete, context);
+}
+
+// Interrupt context: stores a finished scan and hands off a completed half of the ring
+static void spi_stream_store(spi_stream_t* stream) {
+  spi_stream_config_t* config = &stream->config;
+  uint16_t half = config->frame_count / 2;
+
+  stream->head++;
+  stream->scans++;
+  if(stream->head != half && stream->head != config->frame_count) return;
+
+  const spi_stream_frame_t* block = &config->frames[stream->head - half];
+  if(stream->head == config->frame_count) stream->head = 0;
+  if(config->on_block != NULL) config->on_block(stream, block, half, config->context);
+}
+
+// Interrupt context: ends the scan and unlocks the bus, a stopped stream leaves its slot
+static void spi_stream_end(spi_stream_t* stream, uint8_t spi_idx, uint8_t status) {
+  if(status == HAL_OK) spi_stream_store(stream);
+  else stream->errors++;
+
+  stream->busy = false;
+  if(!stream->running) streams[spi_idx] = NULL;
+  SPI_GiveSemaphore(semaphores[spi_idx]);
+}
+
+static void spi_stream_frame_done(spi_stream_t* stream) {
+  spi_target_cs(&stream->target, false);
+  stream->config.frames[stream->head].samples[stream->channel++] = (uint16_t) ((stream->rx[0] << 8) | stream->rx[1]);
+}
+
+// Interrupt context: starts the next conversion frame of the scan in its own CS frame, or ends the scan.
+// Frames always run DMA/IT regardless of the polled threshold, a polled frame would busy wait in the interrupt.
+static void spi_stream_run(spi_stream_t* stream, uint8_t spi_idx) {
+  spi_segment_t frame = { .tx = stream->tx, .rx = stream->rx, .len = SPI_STREAM_FRAME_BYTES };
+
+  if(stream->channel == stream->config.channels) {
+    spi_stream_end(stream, spi_idx, HAL_OK);
+    return;
+  }
+
+  spi_target_cs(&stream->target, true);
+  if(spi_chunk_start(stream->target.spi_h, &frame) != HAL_OK) {
+    spi_target_cs(&stream->target, false);
+    spi_stream_end(stream, spi_idx, HAL_ERROR);
+  }
+}
+
+static void spi_stream_complete(spi_stream_t* stream, uint8_t spi_idx, uint8_t status) {
+  if(status != HAL_OK) {
+    spi_target_cs(&stream->target, false);
+    spi_stream_end(stream, spi_idx, status);
+    return;
+  }
+
+  spi_stream_frame_done(stream);
+  spi_stream_run(stream, spi_idx);
+}
+
+/**
+ * Starts streaming acquisition on the bus of target, see spi_stream_t.
+ * The scans begin with the next SPI_Stream_Tick().
+ * @param stream caller-owned, valid until SPI_Stream_Stop()
+ * @param target bus handle and Chip-Select of the converter
+ * @param settings loaded before a scan if another device changed the bus, NULL: keep the bus as it is
+ * @param config frame ring, channels per scan, command word and block callback
+ * @return
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U, invalid config or the bus has no semaphore yet
+  HAL_BUSY     = 0x02U, the bus already streams
+ */
+uint8_t SPI_Bus_StreamStart(spi_stream_t* stream, const spi_target_t* target, const spi_settings_t* settings,
+    const spi_stream_config_t* config)
+{
+  uint8_t spi_idx = get_spi_index(target->spi_h->Instance);
+
+  if(spi_idx >= SPI_BUS_COUNT || semaphores[spi_idx] == NULL || config->frames == NULL ||
+     config->frame_count < 2 || (config->frame_count % 2) != 0 ||
+     config->channels == 0 || config->channels > SPI_STREAM_MAX_CHANNELS) {
+    return HAL_ERROR;
+  }
+  if(streams[spi_idx] != NULL) return HAL_BUSY;
+
+  memset(stream, 0, sizeof(*stream));
+  stream->target = *target;
+  stream->has_settings = (settings != NULL);
+  if(settings != NULL) stream->settings = *settings;
+  stream->config = *config;
+  stream->tx[0] = (uint8_t) (config->command >> 8);
+  stream->tx[1] = (uint8_t) config->command;
+
+  streams[spi_idx] = stream;
+  stream->running = true;
+  return HAL_OK;
+}
+
+uint8_t SPI_Device_StreamStart(void* device_h, spi_stream_t* stream, const spi_stream_config_t* config)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+  spi_target_t target = {
+      .spi_h = device->spi_h,
+      .cs_port = device->spi_cs_port,
+      .cs_pin = device->spi_cs_pin,
+      .cs_active = GPIO_PIN_RESET, // Chip-Select low active
+      .polled_threshold = device->polled_threshold,
+      .stats = &device->stats,
+      .timeout_ms = device->timeout_ms,
+      .retries = device->retries,
+      .settings = spi_device_settings(device),
+  };
+
+  return SPI_Bus_StreamStart(stream, &target, spi_device_settings(device), config);
+}
+
+/**
+ * Paces the stream: call from the period elapsed interrupt of the sampling timer.
+ * Starts one scan if the bus is free, otherwise the scan is dropped and counted as overrun.
+ * @param stream started with SPI_Bus_StreamStart()
+ */
+void SPI_Stream_Tick(spi_stream_t* stream)
+{
+  SPI_HandleTypeDef* spi_h = stream->target.spi_h;
+  uint8_t spi_idx = get_spi_index(spi_h->Instance);
+
+  if(!stream->running) return;
+
+  if(stream->busy) {
+    // Stuck DMA frame: the abort completes the scan with HAL_TIMEOUT through spi_bus_complete()
+    stream->overruns++;
+    if(++stream->stalled == SPI_STREAM_STALL_TICKS) HAL_SPI_Abort_IT(spi_h);
+    return;
+  }
+
+  // Never waits, a task holding the bus keeps it
+  if(SPI_TakeSemaphoreTimeout(semaphores[spi_idx], 0) != osOK) {
+    stream->overruns++;
+    return;
+  }
+
+  if(stream->has_settings && !spi_bus_loaded(spi_idx, &stream->settings) &&
+     spi_bus_load(spi_h, &stream->settings) != HAL_OK) {
+    stream->errors++;
+    SPI_GiveSemaphore(semaphores[spi_idx]);
+    return;
+  }
+
+  stream->busy = true;
+  stream->stalled = 0;
+  stream->channel = 0;
+  stream->config.frames[stream->head].timestamp = SPI_GetCycles();
+  spi_stream_run(stream, spi_idx);
+}
+
+/**
+ * Stops the scans, a scan in flight still finishes into the ring.
+ * The timer's interrupt must be within configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ * @param stream started with SPI_Bus_StreamStart()
+ */
+void SPI_Stream_Stop(spi_stream_t* stream)
+{
+  uint8_t spi_idx = get_spi_index(stream->target.spi_h->Instance);
+
+  taskENTER_CRITICAL();
+  stream->running = false;
+  if(!stream->busy && spi_idx < SPI_BUS_COUNT && streams[spi_idx] == stream) streams[spi_idx] = NULL;
+  taskEXIT_CRITICAL();
+}
+
+/**
+ * Measures transactions per second of len byte full-duplex transfers on the bus,
+ * without selecting a device. Needs the scheduler running, before that every
+ * transfer is polled.
+ * @param spi_h bus
+ * @param settings loaded after locking for each transfer, NULL: measure at the bus' current settings
+ * @param len transfer length, up to SPI_CALIBRATION_MAX_LEN
+ * @param iterations transfers to average over
+ * @param polled true: polled FIFO transfers, false: DMA/IT
+ * @return transactions/s, 0 on invalid arguments
+ */
+uint32_t SPI_Bus_MeasureTransactions(SPI_HandleTypeDef* spi_h, const spi_settings_t* settings, uint16_t len,
+    uint16_t iterations, bool polled)
+{
+  // Content doesn't matter, no device is selected
+  static uint8_t dummy_tx[SPI_CALIBRATION_MAX_LEN];
+  static uint8_t dummy_rx[SPI_CALIBRATION_MAX_LEN];
+  spi_target_t target = {
+      .spi_h = spi_h,
+      .cs_port = NULL,
+      .settings = settings,
+      .polled_only = polled,
+  };
+  spi_segment_t segment = { .tx = dummy_tx, .rx = dummy_rx, .len = len };
+  uint32_t start, cycles;
+
+  if(spi_h == NULL || len == 0 || len > SPI_CALIBRATION_MAX_LEN || iterations == 0) return 0;
+
+  start = SPI_GetCycles();
+  for(uint16_t i = 0; i < iterations; i++) {
+    SPI_Bus_Transfer(&target, &segment, 1);
+  }
+  cycles = SPI_GetCycles() - start;
+
+  if(cycles == 0) return 0;
+  return (uint32_t) (((uint64_t) SystemCoreClock * iterations) / cycles);
+}
+
+/**
+ * Finds the smallest power of two length at which DMA beats polling on this bus
+ * at the given settings. Call from a task, with the scheduler running.
+ * @param spi_h bus
+ * @param settings see SPI_Bus_MeasureTransactions()
+ * @return polled threshold, SPI_CALIBRATION_MAX_LEN * 2 if polling always won
+ */
+uint16_t SPI_Bus_CalibratePolledThreshold(SPI_HandleTypeDef* spi_h, const spi_settings_t* settings)
+{
+  uint16_t len;
+
+  for(len = 1; len <= SPI_CALIBRATION_MAX_LEN; len <<= 1) {
+    if(SPI_Bus_MeasureTransactions(spi_h, settings, len, SPI_CALIBRATION_ITERATIONS, false) >=
+       SPI_Bus_MeasureTransactions(spi_h, settings, len, SPI_CALIBRATION_ITERATIONS, true)) {
+      break;
+    }
+  }
+
+  return len;
+}
+
+uint16_t SPI_Device_CalibratePolledThreshold(void* device_h)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+
+  // Measure at the device's own clock, loaded under the bus lock of every measured transfer
+  device->polled_threshold = SPI_Bus_CalibratePolledThreshold(device->spi_h, spi_device_settings(device));
+
+  return device->polled_threshold;
+}
+
+uint8_t SPI_Device_Transfer(void* device_h, const spi_segment_t* segments, uint8_t count)
+{
+  spi_device_t* device = (spi_device_t*) device_h;
+  spi_target_t target = {
+      .spi_h = device->spi_h,
+      .cs_port = device->spi_cs_port,
+      .cs_pin = device->spi_cs_pin,
+      .cs_active = GPIO_PIN_RESET, // Chip-Select low active
+      .polled_threshold = device->polled_threshold,
+      .stats = &device->stats,
+      .timeout_ms = device->timeout_ms,
+      .retries = device->retries,
+      .settings = spi_device_settings(device),
+  };
+
+  return SPI_Bus_Transfer(&target, segments, count);
+}
+
+/**
+ * Writes all spans in one CS frame, see spi_iovec_t.
+ * @param device_h
+ * @param iov spans to write
+ * @param count number of spans
+ * @return
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+ */
+uint8_t SPI_Device_WriteV(void* device_h, const spi_iovec_t* iov, uint8_t count)
+{
+  return SPI_Device_WriteThenReadV(device_h, iov, count, NULL, 0);
+}
+
+uint8_t SPI_Device_ReadV(void* device_h, const spi_iovec_t* iov, uint8_t count)
+{
+  return SPI_Device_WriteThenReadV(device_h, NULL, 0, iov, count);
+}
+
+/**
+ * Writes the tx spans, then reads into the rx spans, all in one CS frame.
+ * @param device_h
+ * @param tx_iov spans to write, e.g. command header and payload
+ * @param tx_count
+ * @param rx_iov spans to read into
+ * @param rx_count
+ * @return
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+ */
+uint8_t SPI_Device_WriteThenReadV(void* device_h, const spi_iovec_t* tx_iov, uint8_t tx_count, const spi_iovec_t* rx_iov, uint8_t rx_count)
+{
+  spi_bus_guard_t guard;
+
+  SPI_Device_Acquire(&guard, device_h);
+  SPI_Guard_WriteThenReadV(&guard, tx_iov, tx_count, rx_iov, rx_count);
+  return SPI_Bus_Release(&guard);
+}
+
+void spi_device_activate_cs(uint16_t pin, GPIO_TypeDef* pin_port)
+{
+  // Chip-Select low active
+  HAL_GPIO_WritePin(pin_port,pin,GPIO_PIN_RESET);
+}
+
+void spi_device_deactivate_cs(uint16_t pin, GPIO_TypeDef* pin_port)
+{
+  // Chip-Select low active
+  HAL_GPIO_WritePin(pin_port,pin,GPIO_PIN_SET);
+}
+
+osStatus SPI_TakeSemaphore(osSemaphoreId semaphore_id) {
+  return SPI_TakeSemaphoreTimeout(semaphore_id, SPI_RTOS_TIMEOUT_MS);
+}
+
+// Not osOK: the semaphore was not taken, the caller has to recover (see spi_bus_resync())
+osStatus SPI_TakeSemaphoreTimeout(osSemaphoreId semaphore_id, uint32_t millisec) {
+  return (osStatus) osSemaphoreWait(semaphore_id, millisec);
+}
+
+void SPI_GiveSemaphore(osSemaphoreId semaphore_id) {
+  // Release the Semaphore
+  volatile osStatus result = osSemaphoreRelease(semaphore_id);
 
   if (result != osOK){
     // TODO Error Handling
@@ -10,8 +10,87 @@
 
 #include "atnc_config.h"
 #include "cmsis_os.h"
+#include "stdbool.h"
 
 #define SPI_RTOS_TIMEOUT_MS 1000
+#define SPI_BUS_COUNT       6   // SPI1 - SPI6
+#define SPI_WTR_FRAME_SIZE  32  // Write-then-read frames up to this size use a single full-duplex transfer
+#define SPI_WTR_DUMMY_BYTE  0xFF
+#define SPI_DMA_MAX_CHUNK   0xFFFFU // Longest single HAL transfer (16 bit Size / DMA NDTR), longer segments are chunked
+
+// Polled vs. DMA: segments shorter than the device's polled_threshold are transferred polled
+#define SPI_POLLED_THRESHOLD_DEFAULT  8
+#define SPI_CALIBRATION_MAX_LEN       64  // Longest transfer measured by the calibration
+#define SPI_CALIBRATION_ITERATIONS    32
+
+// Recovery of hung transfers: a transfer not finished within its wire time plus the device's
+// deadline margin is aborted, the bus resynchronised and the transaction list retried
+#define SPI_DEADLINE_DEFAULT_MS 5     // Deadline margin on top of the wire time
+#define SPI_RETRY_DEFAULT       0     // Retries of a failed transaction list, only for lists safe to repeat
+#define SPI_ABORT_TIMEOUT_MS    2     // Wait for HAL_SPI_Abort_IT() before aborting blocking
+
+// Scatter-gather (see spi_iovec_t)
+#define SPI_IOV_MAX             8     // Spans per call (tx + rx), the segment list is built on the stack
+
+// DMA and the Cortex-M7 data cache: transmit buffers are cleaned before a DMA transfer, receive
+// buffers invalidated before and after it. A receive buffer not made of whole cache lines goes
+// through a pool buffer (SPI_DMA_Alloc()), a longer one only with its partial first and last
+// line. A chunk that finds the pool exhausted is transferred by IT instead.
+#define SPI_DCACHE_LINE         32
+#define SPI_DMA_POOL_COUNT      8     // Up to 32
+#define SPI_DMA_POOL_SIZE       512   // Bytes per buffer, a multiple of SPI_DCACHE_LINE
+
+// Streaming acquisition (see spi_stream_t)
+#define SPI_STREAM_MAX_CHANNELS 8     // Conversion frames per scan
+#define SPI_STREAM_FRAME_BYTES  2     // One 16 bit conversion per CS frame
+#define SPI_STREAM_STALL_TICKS  4     // Ticks a scan may stay in flight before it is aborted
+
+// Statistics
+#define SPI_STATS_MAX_DEVICES   16    // Devices listed by SPI_Stats_GetDevice()
+#define SPI_UTIL_WINDOW_MS      1000  // Sliding window of the bus utilisation
+#define SPI_UTIL_SLOTS          8     // The window advances in steps of SPI_UTIL_WINDOW_MS / SPI_UTIL_SLOTS
+
+// Peripheral clocks of the build-time baud rate report (spi_device_config.h), the bus layer
+// uses the clocks read at runtime. Should match SystemClock_Config() (216 MHz core, APB1 /4, APB2 /2)
+#ifndef SPI_PCLK1_HZ
+#define SPI_PCLK1_HZ  54000000U   // APB1: SPI2, SPI3
+#endif
+#ifndef SPI_PCLK2_HZ
+#define SPI_PCLK2_HZ  108000000U  // APB2: SPI1, SPI4, SPI5, SPI6
+#endif
+
+// Baud rate prescaler as integer expressions, usable in #if, constant initializers and at runtime.
+// SPI_BR_FOR selects the CR1 BR field (0..7) of the fastest clock PCLK / 2^(BR+1) that does not exceed baud.
+#define SPI_CLK_DIV_CEIL(pclk, n)   (((pclk) + (1UL << (n)) - 1) >> (n))
+#define SPI_BR_FOR(pclk, baud) \
+  ((SPI_CLK_DIV_CEIL(pclk, 1) <= (baud)) ? 0 : (SPI_CLK_DIV_CEIL(pclk, 2) <= (baud)) ? 1 : \
+   (SPI_CLK_DIV_CEIL(pclk, 3) <= (baud)) ? 2 : (SPI_CLK_DIV_CEIL(pclk, 4) <= (baud)) ? 3 : \
+   (SPI_CLK_DIV_CEIL(pclk, 5) <= (baud)) ? 4 : (SPI_CLK_DIV_CEIL(pclk, 6) <= (baud)) ? 5 : \
+   (SPI_CLK_DIV_CEIL(pclk, 7) <= (baud)) ? 6 : 7)
+#define SPI_BAUDRATE_EFFECTIVE(pclk, baud)  ((pclk) >> (SPI_BR_FOR(pclk, baud) + 1))
+#define SPI_BAUDRATEPRESCALER_FOR(pclk, baud) ((uint32_t) SPI_BR_FOR(pclk, baud) << SPI_CR1_BR_Pos)
+
+// Maps the SPI instance to its bus index (SPI1 -> 0 ... SPI6 -> 5)
+static inline uint8_t get_spi_index(SPI_TypeDef *spi_inst) {
+  if (spi_inst == SPI1) return 0;
+  if (spi_inst == SPI2) return 1;
+  if (spi_inst == SPI3) return 2;
+  if (spi_inst == SPI4) return 3;
+  if (spi_inst == SPI5) return 4;
+  if (spi_inst == SPI6) return 5;
+  return -1; // error
+}
+
+// Cycle Counter (DWT), used for timing statistics
+void SPI_CycleCounterInit(void);
+#ifdef SPI_HOST_BUILD
+// Host build (see host/hal_spi_host.h): no DWT, cycles are derived from the monotonic clock
+uint32_t SPI_GetCycles(void);
+#else
+static inline uint32_t SPI_GetCycles(void) {
+  return DWT->CYCCNT;
+}
+#endif
 
 // Override __weak HAL-Functions for Interrupt based SPI Communication
 void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
@@ -20,33 +99,81 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
 void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi);
 void HAL_SPI_AbortCpltCallback(SPI_HandleTypeDef *hspi);
 
+// Called in task context after a failed transfer was aborted and the bus resynchronised,
+// status is HAL_TIMEOUT for a missed deadline. __weak, override to raise an error event.
+void SPI_Bus_RecoveryCallback(SPI_HandleTypeDef *hspi, uint8_t status);
+
 // RTOS Functions
-void SPI_TakeSemaphore(osSemaphoreId semaphore_id);
+osStatus SPI_TakeSemaphore(osSemaphoreId semaphore_id);
+osStatus SPI_TakeSemaphoreTimeout(osSemaphoreId semaphore_id, uint32_t millisec);
 void SPI_GiveSemaphore(osSemaphoreId semaphore_id);
 
+/**
+ * One segment of a transaction list.
+ * The whole list is executed back-to-back under a single bus lock, Chip-Select
+ * is asserted before the first segment and after every segment that released it.
+ *
+ * tx == NULL: receive only, rx == NULL: transmit only, both set: full duplex
+ * keep_cs:    CS stays asserted for the next segment, otherwise the frame ends here
+ * delay_us:   busy wait after the segment (and after CS release)
+ */
+typedef struct __SPI_Segment_TypeDef
+{
+  const uint8_t*  tx;
+  uint8_t*        rx;
+  uint32_t        len;        // Split into SPI_DMA_MAX_CHUNK transfers under the same CS
+  bool            keep_cs;
+  uint16_t        delay_us;
+}spi_segment_t;
+
+/**
+ * Buffer span of a scatter-gather transfer (write: source, read: destination).
+ * All spans of one call are transferred back-to-back in a single CS frame,
+ * DMA is re-armed between them, e.g. command header + caller's payload without a copy.
+ * The spans of a call form one transaction list, a retry repeats the whole frame.
+ */
+typedef struct __SPI_Iovec_TypeDef
+{
+  void*           base;
+  uint32_t        len;
+}spi_iovec_t;
+
 //spi_device_t spi_device_handles[NUM_SPI_DEVICES];
-uint8_t SPI_DeviceRead(void* device_h, uint8_t* rx_buffer, uint8_t data_count);
-uint8_t SPI_DeviceRead_async(void* device_h, uint8_t* rx_buffer, uint8_t data_count);
+uint8_t SPI_DeviceRead(void* device_h, uint8_t* rx_buffer, uint32_t data_count);
+uint8_t SPI_DeviceRead_async(void* device_h, uint8_t* rx_buffer, uint32_t data_count);
 
-uint8_t SPI_DeviceWrite(void* device_h, uint8_t* tx_buffer, uint8_t data_count);
-uint8_t SPI_DeviceWrite_async(void* device_h, uint8_t* tx_buffer, uint8_t data_count);
+uint8_t SPI_DeviceWrite(void* device_h, uint8_t* tx_buffer, uint32_t data_count);
+uint8_t SPI_DeviceWrite_async(void* device_h, uint8_t* tx_buffer, uint32_t data_count);
 
-uint8_t SPI_Device_WriteThenRead(void* device_h, uint8_t* tx_buffer, uint8_t tx_len, uint8_t* rx_buffer, uint8_t rx_len);
-uint8_t SPI_Device_WriteThenRead_async(void* device_h, uint8_t* tx_buffer, uint8_t tx_len, uint8_t* rx_buffer, uint8_t rx_len);
+uint8_t SPI_Device_WriteThenRead(void* device_h, uint8_t* tx_buffer, uint32_t tx_len, uint8_t* rx_buffer, uint32_t rx_len);
+uint8_t SPI_Device_WriteThenRead_async(void* device_h, uint8_t* tx_buffer, uint32_t tx_len, uint8_t* rx_buffer, uint32_t rx_len);
 
-uint8_t SPI_Device_WriteWhileRead(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint8_t txrx_len);
-uint8_t SPI_Device_WriteWhileRead_async(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint8_t txrx_len);
+uint8_t SPI_Device_WriteWhileRead(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t txrx_len);
+uint8_t SPI_Device_WriteWhileRead_async(void* device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t txrx_len);
 
 
 uint8_t SPI_Device_ConfigSPI(void* device_h);
+// Forces the next SPI_Device_ConfigSPI() on this bus to run HAL_SPI_Init,
+// needed after spi_h->Init was changed outside of SPI_Device_ConfigSPI()
+void SPI_Bus_InvalidateConfig(SPI_TypeDef* spi_inst);
+
+// Transaction lists, see spi_segment_t
+uint8_t SPI_Device_Transfer(void* device_h, const spi_segment_t* segments, uint8_t count);
+
+// Scatter-gather, see spi_iovec_t
+uint8_t SPI_Device_WriteV(void* device_h, const spi_iovec_t* iov, uint8_t count);
+uint8_t SPI_Device_ReadV(void* device_h, const spi_iovec_t* iov, uint8_t count);
+uint8_t SPI_Device_WriteThenReadV(void* device_h, const spi_iovec_t* tx_iov, uint8_t tx_count, const spi_iovec_t* rx_iov, uint8_t rx_count);
 
 void spi_device_activate_cs(uint16_t pin, GPIO_TypeDef* pin_port);
 void spi_device_deactivate_cs(uint16_t pin, GPIO_TypeDef* pin_port);
 
-typedef uint8_t (*fp_spi_device_rw)(void* spi_device_h, uint8_t* rx_tx_buffer, uint8_t data_count);
-typedef uint8_t (*fp_spi_device_rtw)(void* spi_device_h, uint8_t* tx_buffer, uint8_t tx_len, uint8_t* rx_buffer, uint8_t rx_len);
-typedef uint8_t (*fp_spi_device_rww)(void* spi_device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint8_t rx_len);
+typedef uint8_t (*fp_spi_device_rw)(void* spi_device_h, uint8_t* rx_tx_buffer, uint32_t data_count);
+typedef uint8_t (*fp_spi_device_rtw)(void* spi_device_h, uint8_t* tx_buffer, uint32_t tx_len, uint8_t* rx_buffer, uint32_t rx_len);
+typedef uint8_t (*fp_spi_device_rww)(void* spi_device_h, uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t rx_len);
 typedef uint8_t (*fp_spi_device_config_spi)(void* spi_device_h);
+typedef uint8_t (*fp_spi_device_transfer)(void* spi_device_h, const spi_segment_t* segments, uint8_t count);
+typedef uint8_t (*fp_spi_device_rwv)(void* spi_device_h, const spi_iovec_t* iov, uint8_t count);
 //spi_device_t* GetSPIDeviceHandleFromID(device_id_t ID);
 
 typedef struct __SPI_Bus_Settings_TypeDef
@@ -60,6 +187,23 @@ typedef struct __SPI_Bus_Settings_TypeDef
   uint32_t BaudRate; // if != 0: configureSPI() ignores BaudRatePrescaler
 }spi_settings_t;
 
+/**
+ * Per-device counters, updated by every transfer of the device.
+ * Cycles are core clock cycles (see SPI_GetCycles()).
+ */
+typedef struct __SPI_Device_Stats_TypeDef
+{
+  uint32_t            transactions; // Bus acquisitions and asynchronous transfers
+  uint32_t            errors;       // Failed segments
+  uint32_t            reconfigs;    // HAL_SPI_Init runs for this device
+  uint32_t            timeouts;     // Missed deadlines, each aborted the transfer
+  uint32_t            retries;      // Repeated transaction lists
+  uint32_t            late;         // Asynchronous completions run late, the SPI Task had no room to queue them
+  uint64_t            bytes;
+  uint64_t            wire_cycles;  // Transferring, including the wait for DMA completion
+  uint64_t            wait_cycles;  // Waiting for the bus lock
+}spi_device_stats_t;
+
 typedef struct __SPI_Device_TypeDef
 {
   device_id_t         bus_device_id;
@@ -74,9 +218,201 @@ typedef struct __SPI_Device_TypeDef
   fp_spi_device_rtw   device_write_then_read;
   fp_spi_device_rww   device_write_while_read;
   fp_spi_device_config_spi config_spi;
+  fp_spi_device_transfer device_transfer;
+  fp_spi_device_rwv   device_write_v;
+  fp_spi_device_rwv   device_read_v;
   osSemaphoreId       semaphore_id;
+  uint16_t            polled_threshold; // Segments shorter than this are polled, 0: always DMA/IT
+  uint16_t            timeout_ms;       // Deadline margin, 0: SPI_DEADLINE_DEFAULT_MS
+  uint8_t             retries;          // Retries after a failed, aborted transaction list
+  spi_device_stats_t  stats;
 }spi_device_t;
 
+/**
+ * Bus side of a transaction list, shared by spi_device_t and SPIDevice.
+ * cs_active is the pin state that selects the device (GPIO_PIN_RESET for low active).
+ */
+typedef struct __SPI_Target_TypeDef
+{
+  SPI_HandleTypeDef*  spi_h;
+  GPIO_TypeDef*       cs_port;
+  uint16_t            cs_pin;
+  GPIO_PinState       cs_active;
+  uint16_t            polled_threshold; // see spi_device_t
+  spi_device_stats_t* stats;            // NULL: only the bus utilisation is counted
+  uint16_t            timeout_ms;       // see spi_device_t
+  uint8_t             retries;
+  uint32_t            cs_bsrr_select;   // BSRR words stored to cs_port, e.g. compile time constants of a
+  uint32_t            cs_bsrr_idle;     // fixed pin (see StaticSPIDevice), 0: HAL_GPIO_WritePin() on cs_port/cs_pin
+  const spi_settings_t* settings;       // Loaded after locking if the bus isn't in them, NULL: keep the bus as it is
+  bool                polled_only;      // Every segment polled whatever its length, the bus never waits for DMA/IT
+}spi_target_t;
+
+/**
+ * Bus transaction guard: holds the bus lock and Chip-Select across any number of transfers.
+ * SPI_Bus_Acquire()/SPI_Device_Acquire() lock the bus and select the device, SPI_Guard_*()
+ * transfer without touching the lock, SPI_Bus_Release() deselects and unlocks.
+ */
+typedef struct __SPI_Bus_Guard_TypeDef
+{
+  spi_target_t        target;
+  osSemaphoreId       semaphore_id;
+  bool                blocking; // no scheduler or no semaphore: no lock, polled transfers
+  bool                selected;
+  bool                active;
+  bool                framed;   // data of an earlier call went out in the current CS frame
+  uint8_t             status;   // first failing HAL status, later transfers are skipped
+}spi_bus_guard_t;
+// A failed SPI_Guard_Transfer() call is aborted and repeated from its first segment up to
+// target.retries times, lists that are retried must be safe to repeat. A call continuing a
+// frame of an earlier call (framed) is not retried, the device has already seen the start.
+
 void SPI_DeviceBusInit(spi_device_t* spi_device);
 
+uint8_t SPI_Bus_Acquire(spi_bus_guard_t* guard, const spi_target_t* target);
+uint8_t SPI_Device_Acquire(spi_bus_guard_t* guard, void* device_h);
+uint8_t SPI_Bus_Release(spi_bus_guard_t* guard);
+uint8_t SPI_Guard_Transfer(spi_bus_guard_t* guard, const spi_segment_t* segments, uint8_t count);
+uint8_t SPI_Guard_Write(spi_bus_guard_t* guard, const uint8_t* tx_buffer, uint32_t len);
+uint8_t SPI_Guard_Read(spi_bus_guard_t* guard, uint8_t* rx_buffer, uint32_t len);
+uint8_t SPI_Guard_WriteRead(spi_bus_guard_t* guard, const uint8_t* tx_buffer, uint8_t* rx_buffer, uint32_t len);
+uint8_t SPI_Guard_WriteV(spi_bus_guard_t* guard, const spi_iovec_t* iov, uint8_t count);
+uint8_t SPI_Guard_ReadV(spi_bus_guard_t* guard, const spi_iovec_t* iov, uint8_t count);
+uint8_t SPI_Guard_WriteThenReadV(spi_bus_guard_t* guard, const spi_iovec_t* tx_iov, uint8_t tx_count,
+    const spi_iovec_t* rx_iov, uint8_t rx_count);
+
+uint8_t SPI_Bus_Transfer(const spi_target_t* target, const spi_segment_t* segments, uint8_t count);
+
+/**
+ * Asynchronous transfer, caller-owned and valid until on_complete has run.
+ * SPI_Bus_TransferAsync() locks the bus, selects the device, starts DMA/IT and returns.
+ * The transfer complete (or error) interrupt deselects, unlocks the bus and queues
+ * on_complete into the urgent lane of the bus' SPI Task, so it runs in task context.
+ * A transfer missing its deadline is aborted by the next task waiting for the bus or
+ * by the bus' SPI Task and finishes with HAL_TIMEOUT, it is not retried.
+ * The SPI interrupts therefore produce into the bus' ISR ring (see SPI_Isr_Ring_t)
+ * and must be within configMAX_SYSCALL_INTERRUPT_PRIORITY.
+ */
+typedef struct __SPI_Async_TypeDef spi_async_t;
+typedef void (*fp_spi_async_complete)(spi_async_t* transfer, uint8_t status, void* context);
+
+struct __SPI_Async_TypeDef
+{
+  spi_target_t          target;
+  fp_spi_async_complete on_complete; // Optional, poll SPI_Async_IsPending() otherwise
+  void*                 context;
+  volatile bool         pending;     // Started, on_complete not run yet
+  volatile uint8_t      status;      // HAL status of the finished transfer
+
+  // Remaining chunks, continued from the completion interrupt
+  const uint8_t*        tx;
+  uint8_t*              rx;
+  uint32_t              remaining;
+
+  uint32_t              len;
+  uint32_t              start_cycles;
+  uint32_t              end_cycles;  // Set by the completion interrupt
+  uint32_t              deadline;    // Tick count, a transfer past it is aborted by the next bus user
+  spi_async_t*          late_next;   // Waiting in SPI_Bus_RunLateCompletions() of the bus
+};
+
+uint8_t SPI_Bus_TransferAsync(spi_async_t* transfer, const spi_target_t* target, const uint8_t* tx_buffer, uint8_t* rx_buffer,
+    uint32_t len, fp_spi_async_complete on_complete, void* context);
+uint8_t SPI_Device_TransferAsync(void* device_h, spi_async_t* transfer, const uint8_t* tx_buffer, uint8_t* rx_buffer,
+    uint32_t len, fp_spi_async_complete on_complete, void* context);
+// SPI Task of the bus: runs the on_complete of transfers that finished while its queues were full
+void SPI_Bus_RunLateCompletions(uint8_t spi_idx);
+// SPI Task of the bus: aborts the transfer in flight past its deadline, returns the ticks left until it
+TickType_t SPI_Bus_ExpireAsync(uint8_t spi_idx);
+static inline bool SPI_Async_IsPending(const spi_async_t* transfer) {
+  return transfer->pending;
+}
+
+/**
+ * Streaming acquisition, e.g. the AD7324 with its sequencer cycling the channels.
+ * A timer paces the scans: SPI_Stream_Tick() runs from its period elapsed interrupt,
+ * locks the bus if it is free (without waiting) and clocks config.channels conversion
+ * frames, each in its own CS frame with config.command as the word sent. The frames run
+ * DMA/IT whatever the polled threshold, each is chained from the completion interrupt of
+ * the previous one. The bus is unlocked after the scan, so other devices on it keep working
+ * in between. Neither the SPI Task nor a semaphore handshake per sample is involved.
+ * The tick loads the stream's settings and leaves them in the bus, the next guard or
+ * asynchronous transfer reloads its device's (spi_target_t.settings).
+ *
+ * Every scan lands in the next frame of the caller's ring with its start time. The ring
+ * is double buffered: when a half is complete, on_block gets it while the other half
+ * fills. on_block runs in interrupt context and must only hand the block off (e.g. notify
+ * a task), the half is overwritten one half later.
+ * A tick finding the bus locked or the previous scan still running drops its scan and
+ * counts an overrun, a scan in flight for SPI_STREAM_STALL_TICKS is aborted.
+ * The bus traffic of the stream is not part of the device statistics.
+ */
+typedef struct __SPI_Stream_Frame_TypeDef
+{
+  uint32_t            timestamp;  // SPI_GetCycles() at the start of the scan
+  uint16_t            samples[SPI_STREAM_MAX_CHANNELS]; // Conversion words in scan order
+}spi_stream_frame_t;
+
+typedef struct __SPI_Stream_TypeDef spi_stream_t;
+typedef void (*fp_spi_stream_block)(spi_stream_t* stream, const spi_stream_frame_t* block, uint16_t count, void* context);
+
+typedef struct __SPI_Stream_Config_TypeDef
+{
+  spi_stream_frame_t* frames;       // Ring of two halves
+  uint16_t            frame_count;  // Even, at least 2
+  uint8_t             channels;     // Conversion frames per scan, up to SPI_STREAM_MAX_CHANNELS
+  uint16_t            command;      // Sent in every frame, e.g. 0: no write, the AD7324 keeps sequencing
+  fp_spi_stream_block on_block;     // Interrupt context, optional
+  void*               context;
+}spi_stream_config_t;
+
+struct __SPI_Stream_TypeDef
+{
+  spi_target_t        target;
+  spi_settings_t      settings;
+  bool                has_settings;
+  spi_stream_config_t config;
+
+  volatile bool       running;
+  volatile bool       busy;         // Scan in flight, the stream holds the bus lock
+  uint8_t             channel;      // Conversion frame of the scan in flight
+  uint8_t             stalled;      // Ticks the scan in flight took so far
+  uint16_t            head;         // Frame being filled
+  uint8_t             tx[SPI_STREAM_FRAME_BYTES];
+  uint8_t             rx[SPI_STREAM_FRAME_BYTES];
+
+  // Written from interrupt context
+  volatile uint32_t   scans;
+  volatile uint32_t   overruns;     // Ticks that dropped their scan
+  volatile uint32_t   errors;       // Scans lost to HAL errors and aborts
+};
+
+uint8_t SPI_Bus_StreamStart(spi_stream_t* stream, const spi_target_t* target, const spi_settings_t* settings,
+    const spi_stream_config_t* config);
+uint8_t SPI_Device_StreamStart(void* device_h, spi_stream_t* stream, const spi_stream_config_t* config);
+void SPI_Stream_Tick(spi_stream_t* stream);
+void SPI_Stream_Stop(spi_stream_t* stream);
+
+// Polled vs. DMA calibration, run from a task after the scheduler started
+uint32_t SPI_Bus_MeasureTransactions(SPI_HandleTypeDef* spi_h, const spi_settings_t* settings, uint16_t len,
+    uint16_t iterations, bool polled);
+uint16_t SPI_Bus_CalibratePolledThreshold(SPI_HandleTypeDef* spi_h, const spi_settings_t* settings);
+uint16_t SPI_Device_CalibratePolledThreshold(void* device_h);
+osSemaphoreId SPI_GetBusSemaphore(SPI_TypeDef* spi_inst);
+
+// DMA-safe buffers, see SPI_DCACHE_LINE
+void* SPI_DMA_Alloc(uint32_t len);
+void SPI_DMA_Free(void* buffer);
+bool SPI_DMA_IsSafe(const void* buffer, uint32_t len);
+
+// Statistics, copied consistently
+void SPI_Stats_Get(const spi_device_stats_t* stats, spi_device_stats_t* copy);
+void SPI_Stats_Reset(spi_device_stats_t* stats);
+// Lists the device for SPI_Stats_GetDevice(), done by SPI_DeviceBusInit() for spi_device_t
+bool SPI_Stats_Register(spi_device_stats_t* stats, SPI_TypeDef* spi_inst, uint32_t id);
+// Registered devices by index, false past the last one
+bool SPI_Stats_GetDevice(uint8_t index, spi_device_stats_t* copy, SPI_TypeDef** spi_inst, uint32_t* id);
+// Bus busy time over the last SPI_UTIL_WINDOW_MS in 0.1 %
+uint16_t SPI_Bus_GetUtilisation(SPI_TypeDef* spi_inst);
+
 #endif /* APP_INC_SPI_DEVICES_H_ */
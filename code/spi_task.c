@@ -7,6 +7,34 @@
  * to access the SPI Bus without to block on it and handle the hardware resource to different
  * modules.
  *
+ * One executor (task + queues) is created for every bus listed in spi_executor_configs[].
+ * Executors are indexed like the SPI semaphores in spi_devices.c (see get_spi_index()).
+ *
+ * Each bus owns an urgent and a bulk queue. Queued requests are announced to the task
+ * through its notification value. On each wake-up the task drains both lanes completely:
+ * all pending urgent requests are collected into a batch and executed, and only when the
+ * urgent lane is empty the next bulk request is taken. Interrupt servicing therefore never
+ * waits behind more than the one bulk request that is currently executing.
+ * Pending urgent requests flagged as idempotent are coalesced: duplicates with the same
+ * function and handle collected in one batch are executed only once. Bulk requests are
+ * taken one at a time, an idempotent one is skipped if an identical one started after it
+ * was queued (see SPI_Task_IsCovered()).
+ *
+ * Requests from ISR context don't use the FreeRTOS queues. They are written into a ring per bus
+ * and announced by a direct task notification, the task moves them into the urgent batch or the
+ * bulk lane. Producers of any priority up to configMAX_SYSCALL_INTERRUPT_PRIORITY may share a bus.
+ *
+ * A full lane never stalls the caller forever. Depending on the chosen backpressure the
+ * request is rejected, waits for a bounded time or sheds the oldest queued request, and
+ * every rejected or shed request is counted per lane.
+ *
+ * Requests may carry a caller-owned completion. Its steps run directly after each other
+ * within the same execution, so multi-step sequences don't need to be queued step by step,
+ * and the caller is notified through the completion state and its on-complete callback.
+ *
+ * Every executor keeps statistics (lane high-water marks, wait and run time histograms based
+ * on the DWT cycle counter, executions per request function) to size queues and priorities.
+ *
  *  Created on: 04.12.2019
  *      Author: tw
  */
@@ -16,192 +44,559 @@
 
 #include "spi.h"
 #include "display.h"
+#include "stdbool.h"
+#include "string.h"
 
 
-static QueueHandle_t SPI_QueueHandle;
-static TaskHandle_t SPI_TaskHandle;
+// Executor configuration, add an entry to run a task for another bus
+static const SPI_Executor_Config_t spi_executor_configs[] = {
+	{
+		.Instance = SPI1,
+		.TaskName = "SPI1_Task",
+		.QueueNames = { "SPI1_Urgent", "SPI1_Queue" },
+		.StackSize = SPI_TASK_STACK_SIZE,
+		.QueueSize = { SPI_URGENT_QUEUE_SIZE, SPI_QUEUE_SIZE },
+		.Priority = SPI_TASK_PRIORITY,
+		.ErrorText = "ERROR 4301!"
+	},
+	{
+		.Instance = SPI2,
+		.TaskName = "SPI2_Task",
+		.QueueNames = { "SPI2_Urgent", "SPI2_Queue" },
+		.StackSize = SPI_TASK_STACK_SIZE,
+		.QueueSize = { SPI_URGENT_QUEUE_SIZE, SPI_QUEUE_SIZE },
+		.Priority = SPI_TASK_PRIORITY,
+		.ErrorText = "ERROR 4302!"
+	},
+};
 
-static QueueHandle_t SPI2_QueueHandle;
-static TaskHandle_t SPI2_TaskHandle;
+#define SPI_EXECUTOR_CONFIG_COUNT (sizeof(spi_executor_configs) / sizeof(spi_executor_configs[0]))
+
+static SPI_Executor_t spi_executors[SPI_BUS_COUNT];
 
 void SPI_Task (void* pvParameters);
-void SPI2_Task (void* pvParameters);
+
+static BaseType_t SPI_Executor_Create(SPI_Executor_t* executor, const SPI_Executor_Config_t* config);
+static void SPI_Task_DrainLanes(SPI_Executor_t* executor);
+static void SPI_Completion_Finish(SPI_Completion_t* completion, int32_t result);
 
 
 void SPI_Task_Init(void)
 {
-	BaseType_t taskCreateStatus;
+	// Needed for the latency statistics
+	SPI_CycleCounterInit();
+
+	for (uint8_t i = 0; i < SPI_EXECUTOR_CONFIG_COUNT; i++) {
+		const SPI_Executor_Config_t* config = &spi_executor_configs[i];
+		uint8_t spi_idx = get_spi_index(config->Instance);
+
+		if (spi_idx >= SPI_BUS_COUNT || SPI_Executor_Create(&spi_executors[spi_idx], config) != pdPASS) {
+			// queue or task not created
+			// todo: error!
+			displayBlocking(config->ErrorText, 5000);
+			return;
+		}
+	}
+}
 
-	// SPI1 Task & Queue Init
-	// Setup Queue, Timer and Task for event handling:
-	SPI_QueueHandle = xQueueCreate(SPI_QUEUE_SIZE, sizeof(SPI_Queue_Data_t));
-	if (SPI_QueueHandle == NULL) {
-		// queue not created
-		// todo: error!
-		displayBlocking("ERROR 4301!", 5000);
-		return;
+static BaseType_t SPI_Executor_Create(SPI_Executor_t* executor, const SPI_Executor_Config_t* config)
+{
+	// Setup Queues for event handling:
+	for (uint8_t lane = 0; lane < SPI_PRIO_COUNT; lane++) {
+		executor->Lanes[lane] = xQueueCreate(config->QueueSize[lane], sizeof(SPI_Queue_Data_t));
+		if (executor->Lanes[lane] == NULL) {
+			return pdFAIL;
+		}
+		vQueueAddToRegistry(executor->Lanes[lane], config->QueueNames[lane]);
 	}
-	vQueueAddToRegistry(SPI_QueueHandle, "SPI1_Queue");
 
-	// Create task for handling SPI1 Bus Hardware Peripheral
-	SPI_TaskHandle = NULL;
+	// Create task for handling the SPI Bus Hardware Peripheral
+	executor->TaskHandle = NULL;
 
-	taskCreateStatus = xTaskCreate(SPI_Task, "SPI1_Task",
-			SPI_TASK_STACK_SIZE, (void *) 1,
-			tskIDLE_PRIORITY, &SPI_TaskHandle);
+	if (xTaskCreate(SPI_Task, config->TaskName,
+			config->StackSize, (void *) executor,
+			config->Priority, &executor->TaskHandle) != pdPASS) {
+		return pdFAIL;
+	}
+
+	// Mark as usable only when completely set up
+	executor->Config = config;
+	return pdPASS;
+}
 
-	if (taskCreateStatus != pdPASS) {
-		// something went wrong creating the task
-		// todo: error!
-		displayBlocking("ERROR 4301!", 5000);
-		return;
+SPI_Executor_t* SPI_Task_GetExecutor(SPI_TypeDef* instance)
+{
+	return SPI_Task_GetExecutorByIndex(get_spi_index(instance));
+}
+
+SPI_Executor_t* SPI_Task_GetExecutorByIndex(uint8_t spi_idx)
+{
+	if (spi_idx >= SPI_BUS_COUNT || spi_executors[spi_idx].Config == NULL) {
+		return NULL;
+	}
+	return &spi_executors[spi_idx];
+}
+
+static void SPI_Executor_CountDrop(SPI_Executor_t* executor, SPI_Request_Priority_t priority)
+{
+	taskENTER_CRITICAL();
+	executor->Dropped[priority]++;
+	taskEXIT_CRITICAL();
+}
+
+static void SPI_Executor_CountDrop_fromISR(SPI_Executor_t* executor, SPI_Request_Priority_t priority)
+{
+	UBaseType_t saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+	executor->Dropped[priority]++;
+	taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+}
+
+static void SPI_Executor_TrackDepth(SPI_Executor_t* executor, SPI_Request_Priority_t priority)
+{
+	taskENTER_CRITICAL();
+	UBaseType_t waiting = uxQueueMessagesWaiting(executor->Lanes[priority]);
+	if (waiting > executor->Stats.HighWater[priority]) {
+		executor->Stats.HighWater[priority] = waiting;
 	}
+	taskEXIT_CRITICAL();
+}
 
-	// SPI2 Task & Queue Init
-	// Setup Queue, Timer and Task for event handling:
-	SPI2_QueueHandle = xQueueCreate(SPI_QUEUE_SIZE, sizeof(SPI_Queue_Data_t));
-	if (SPI2_QueueHandle == NULL) {
-		// queue not created
-		// todo: error!
-		displayBlocking("ERROR 4302!", 5000);
-		return;
+SPI_Request_Status_t SPI_Executor_Send_Request(SPI_Executor_t* executor, SPI_Queue_Data_t queue_data, SPI_Request_Priority_t priority,
+		SPI_Backpressure_t backpressure, TickType_t timeout)
+{
+	SPI_Queue_Data_t queuedata = queue_data;
+	SPI_Queue_Data_t discarded;
+	SPI_Request_Status_t status = SPI_REQUEST_OK;
+	QueueHandle_t lane;
+
+	if (executor == NULL || (queue_data.SPI_Request_Fp == NULL && queue_data.Completion == NULL)) return SPI_REQUEST_INVALID;
+	if (priority >= SPI_PRIO_COUNT) priority = SPI_PRIO_BULK;
+	lane = executor->Lanes[priority];
+	queuedata.EnqueueCycles = SPI_GetCycles();
+
+	switch (backpressure) {
+	case SPI_BP_DROP_OLDEST:
+		// Other producers may refill the lane in between, so retry a bounded number of times
+		for (uint8_t attempt = 0; xQueueSendToBack(lane, &queuedata, 0) != pdPASS; attempt++) {
+			if (attempt >= 2) {
+				SPI_Executor_CountDrop(executor, priority);
+				return SPI_REQUEST_QUEUE_FULL;
+			}
+			if (xQueueReceive(lane, &discarded, 0) == pdPASS) {
+				SPI_Executor_CountDrop(executor, priority);
+				if (discarded.Completion != NULL) {
+					SPI_Completion_Finish(discarded.Completion, SPI_COMPLETION_ERR_DROPPED);
+				}
+				status = SPI_REQUEST_DROPPED_OLDEST;
+			}
+		}
+		break;
+	case SPI_BP_FAIL_FAST:
+		timeout = 0;
+		// fall through
+	case SPI_BP_BLOCK:
+	default:
+		if (xQueueSendToBack(lane, &queuedata, timeout) != pdPASS) {
+			SPI_Executor_CountDrop(executor, priority);
+			return SPI_REQUEST_QUEUE_FULL;
+		}
+		break;
 	}
-	vQueueAddToRegistry(SPI2_QueueHandle, "SPI2_Queue");
 
-	// Create task for handling SPI2 Bus Hardware Peripheral
-	SPI2_TaskHandle = NULL;
+	SPI_Executor_TrackDepth(executor, priority);
 
-	taskCreateStatus = xTaskCreate(SPI2_Task, "SPI2_Task",
-			SPI_TASK_STACK_SIZE, (void *) 1,
-			tskIDLE_PRIORITY, &SPI2_TaskHandle);
+	// Wake the task, pending notifications are accumulated until it drains the lanes
+	xTaskNotifyGive(executor->TaskHandle);
+	return status;
+}
+
+SPI_Request_Status_t SPI_Executor_Send_Request_fromISR(SPI_Executor_t* executor, SPI_Queue_Data_t queue_data, SPI_Request_Priority_t priority)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	UBaseType_t saved_interrupt_status;
+	SPI_Isr_Ring_t* ring;
+	uint32_t head, tail;
+
+	if (executor == NULL || (queue_data.SPI_Request_Fp == NULL && queue_data.Completion == NULL)) return SPI_REQUEST_INVALID;
+	if (priority >= SPI_PRIO_COUNT) priority = SPI_PRIO_BULK;
+	ring = &executor->IsrRing;
+
+	// A higher priority interrupt queuing into the same bus must not claim the slot in between,
+	// Tail is released by the SPI Task after reading an entry
+	saved_interrupt_status = taskENTER_CRITICAL_FROM_ISR();
+	head = ring->Head;
+	tail = __atomic_load_n(&ring->Tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= SPI_ISR_RING_SIZE) {
+		taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
+		SPI_Executor_CountDrop_fromISR(executor, priority);
+		return SPI_REQUEST_QUEUE_FULL;
+	}
 
-	if (taskCreateStatus != pdPASS) {
-		// something went wrong creating the task
-		// todo: error!
-		displayBlocking("ERROR 4302!", 5000);
-		return;
+	ring->Entries[head & (SPI_ISR_RING_SIZE - 1)].Data = queue_data;
+	ring->Entries[head & (SPI_ISR_RING_SIZE - 1)].Data.EnqueueCycles = SPI_GetCycles();
+	ring->Entries[head & (SPI_ISR_RING_SIZE - 1)].Priority = priority;
+	__atomic_store_n(&ring->Head, head + 1, __ATOMIC_RELEASE);
+
+	if (head + 1 - tail > executor->Stats.IsrRingHighWater) {
+		executor->Stats.IsrRingHighWater = head + 1 - tail;
 	}
+	taskEXIT_CRITICAL_FROM_ISR(saved_interrupt_status);
 
+	// Direct notification, only switch context if the SPI Task has a higher priority
+	vTaskNotifyGiveFromISR(executor->TaskHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	return SPI_REQUEST_OK;
 }
 
-void SPI_Task_Send_Request(SPI_Queue_Data_t queue_data)
+SPI_Request_Status_t SPI_Executor_QueueRequest(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction, void *pData, SPI_Request_Priority_t priority)
 {
-	SPI_Queue_Data_t queuedata = queue_data;
+	SPI_Queue_Data_t spi_request = {0};
 
-	if(xQueueSendToBack(SPI_QueueHandle,&queuedata,( TickType_t )100) != pdPASS) {
-		while(1) {
-			// pass
-		}
+	spi_request.Handle = pData;
+	spi_request.SPI_Request_Fp = requestFunction;
+	return SPI_Executor_Send_Request(executor, spi_request, priority, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT);
+}
+
+SPI_Request_Status_t SPI_Executor_QueueRequest_fromISR(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction, void *pData, SPI_Request_Priority_t priority)
+{
+	SPI_Queue_Data_t spi_request = {0};
+
+	spi_request.Handle = pData;
+	spi_request.SPI_Request_Fp = requestFunction;
+	return SPI_Executor_Send_Request_fromISR(executor, spi_request, priority);
+}
+
+bool SPI_Queue_Data_SetArgs(SPI_Queue_Data_t* queue_data, const void* args, uint8_t size)
+{
+	if (size > SPI_REQUEST_ARG_SIZE || (size != 0 && args == NULL)) return false;
+
+	memcpy(queue_data->Args.Bytes, args, size);
+	queue_data->ArgSize = size;
+	return true;
+}
+
+SPI_Request_Status_t SPI_Executor_QueueRequestArgs(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction,
+		const void* args, uint8_t size, SPI_Request_Priority_t priority)
+{
+	SPI_Queue_Data_t spi_request = {0};
+
+	if (!SPI_Queue_Data_SetArgs(&spi_request, args, size)) return SPI_REQUEST_INVALID;
+
+	spi_request.SPI_Request_Fp = requestFunction;
+	return SPI_Executor_Send_Request(executor, spi_request, priority, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT);
+}
+
+bool SPI_Completion_Init(SPI_Completion_t* completion, Fp_SPI_Completion_Callback onComplete, void* context)
+{
+	if (completion == NULL || SPI_Completion_IsPending(completion)) return false;
+
+	completion->State = SPI_COMPLETION_IDLE;
+	completion->Result = 0;
+	completion->StepsRun = 0;
+	completion->StepCount = 0;
+	completion->OnComplete = onComplete;
+	completion->Context = context;
+	return true;
+}
+
+bool SPI_Completion_Then(SPI_Completion_t* completion, Fp_SPI_Queue_Step step)
+{
+	if (completion == NULL || step == NULL || SPI_Completion_IsPending(completion)) return false;
+	if (completion->StepCount >= SPI_COMPLETION_MAX_STEPS) return false;
+
+	completion->Steps[completion->StepCount++] = step;
+	return true;
+}
+
+SPI_Completion_t* SPI_Executor_QueueSteps(SPI_Executor_t* executor, SPI_Completion_t* completion,
+		const void* args, uint8_t size, SPI_Request_Priority_t priority, SPI_Backpressure_t backpressure, TickType_t timeout)
+{
+	SPI_Queue_Data_t spi_request = {0};
+	SPI_Request_Status_t status;
+
+	if (completion == NULL || completion->StepCount == 0 || SPI_Completion_IsPending(completion)) return NULL;
+	if (!SPI_Queue_Data_SetArgs(&spi_request, args, size)) return NULL;
+
+	completion->State = SPI_COMPLETION_PENDING;
+	completion->Result = 0;
+	completion->StepsRun = 0;
+
+	spi_request.Completion = completion;
+	status = SPI_Executor_Send_Request(executor, spi_request, priority, backpressure, timeout);
+
+	if (status != SPI_REQUEST_OK && status != SPI_REQUEST_DROPPED_OLDEST) {
+		completion->State = SPI_COMPLETION_IDLE;
+		return NULL;
 	}
+	return completion;
 }
 
-void SPI2_Task_Send_Request(SPI_Queue_Data_t queue_data)
+// Publishes the result before calling back, so the callback may re-queue the completion
+static void SPI_Completion_Finish(SPI_Completion_t* completion, int32_t result)
 {
-	SPI_Queue_Data_t queuedata = queue_data;
+	completion->Result = result;
+	completion->State = (result < 0) ? SPI_COMPLETION_FAILED : SPI_COMPLETION_DONE;
 
-	if(xQueueSendToBack(SPI2_QueueHandle,&queuedata,( TickType_t )100) != pdPASS) {
-		while(1) {
-			// pass
-		}
+	if (completion->OnComplete != NULL) {
+		completion->OnComplete(completion, completion->Context);
 	}
 }
 
-void SPI_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data)
+static void SPI_Completion_Run(SPI_Completion_t* completion, void* Handle)
 {
-	SPI_Queue_Data_t queuedata = queue_data;
-	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	int32_t result = 0;
 
-	if(xQueueSendToBackFromISR(SPI_QueueHandle, &queuedata, &xHigherPriorityTaskWoken) != pdPASS) {
-		while(1) {
-			// pass
-		}
+	for (uint8_t step = 0; step < completion->StepCount; step++) {
+		completion->StepsRun++;
+		result = completion->Steps[step](Handle);
+		if (result < 0) break;
 	}
-	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+
+	SPI_Completion_Finish(completion, result);
 }
 
-void SPI2_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data)
+uint32_t SPI_Executor_GetDropCount(SPI_Executor_t* executor, SPI_Request_Priority_t priority)
 {
-	SPI_Queue_Data_t queuedata = queue_data;
-	BaseType_t xHigherPriorityTaskWoken = pdTRUE; //pdFALSE;
+	if (executor == NULL || priority >= SPI_PRIO_COUNT) return 0;
+	return executor->Dropped[priority];
+}
+
+bool SPI_Executor_GetStats(SPI_Executor_t* executor, SPI_Executor_Stats_t* stats)
+{
+	if (executor == NULL || stats == NULL) return false;
+
+	taskENTER_CRITICAL();
+	*stats = executor->Stats;
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+void SPI_Executor_ResetStats(SPI_Executor_t* executor)
+{
+	if (executor == NULL) return;
+
+	taskENTER_CRITICAL();
+	memset(&executor->Stats, 0, sizeof(executor->Stats));
+	taskEXIT_CRITICAL();
+}
 
-	if(xQueueSendToBackFromISR(SPI2_QueueHandle, &queuedata, &xHigherPriorityTaskWoken) != pdPASS) {
-		while(1) {
-			// pass
+static uint8_t SPI_Stats_Bucket(uint32_t cycles)
+{
+	if (cycles == 0) return 0;
+
+	int32_t bucket = (31 - __builtin_clz(cycles)) - SPI_STATS_HIST_SHIFT;
+	if (bucket < 0) return 0;
+	if (bucket >= SPI_STATS_HIST_BUCKETS) return SPI_STATS_HIST_BUCKETS - 1;
+	return (uint8_t) bucket;
+}
+
+// Called by the executing task only
+static void SPI_Stats_Record(SPI_Executor_Stats_t* stats, const void* function, uint32_t wait_cycles, uint32_t run_cycles)
+{
+	stats->WaitHistogram[SPI_Stats_Bucket(wait_cycles)]++;
+	stats->RunHistogram[SPI_Stats_Bucket(run_cycles)]++;
+	if (wait_cycles > stats->MaxWaitCycles) stats->MaxWaitCycles = wait_cycles;
+	if (run_cycles > stats->MaxRunCycles) stats->MaxRunCycles = run_cycles;
+
+	for (uint8_t i = 0; i < SPI_STATS_MAX_FUNCTIONS; i++) {
+		if (stats->Functions[i].Function == function || stats->Functions[i].Function == NULL) {
+			stats->Functions[i].Function = function;
+			stats->Functions[i].Executions++;
+			return;
 		}
 	}
-	portEND_SWITCHING_ISR(xHigherPriorityTaskWoken);
+	stats->OtherExecutions++;
 }
 
-void SPI_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData)
+SPI_Request_Status_t SPI_Task_Send_Request(SPI_Queue_Data_t queue_data)
 {
-	SPI_Queue_Data_t spi_request;
+	return SPI_Executor_Send_Request(SPI_Task_GetExecutor(SPI1), queue_data, SPI_PRIO_BULK, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT);
+}
 
-	if (requestFunction == NULL) return;
+SPI_Request_Status_t SPI2_Task_Send_Request(SPI_Queue_Data_t queue_data)
+{
+	return SPI_Executor_Send_Request(SPI_Task_GetExecutor(SPI2), queue_data, SPI_PRIO_BULK, SPI_BP_BLOCK, SPI_QUEUE_TIMEOUT);
+}
 
-	spi_request.Handle = pData;
-	spi_request.SPI_Request_Fp = requestFunction;
-	SPI_Task_Send_Request(spi_request);
+SPI_Request_Status_t SPI_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data)
+{
+	return SPI_Executor_Send_Request_fromISR(SPI_Task_GetExecutor(SPI1), queue_data, SPI_PRIO_BULK);
 }
 
-void SPI2_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData)
+SPI_Request_Status_t SPI2_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data)
 {
-	SPI_Queue_Data_t spi_request;
+	return SPI_Executor_Send_Request_fromISR(SPI_Task_GetExecutor(SPI2), queue_data, SPI_PRIO_BULK);
+}
 
-	if (requestFunction == NULL) return;
+SPI_Request_Status_t SPI_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData)
+{
+	return SPI_Executor_QueueRequest(SPI_Task_GetExecutor(SPI1), requestFunction, pData, SPI_PRIO_BULK);
+}
 
-	spi_request.Handle = pData;
-	spi_request.SPI_Request_Fp = requestFunction;
-	SPI2_Task_Send_Request(spi_request);
+SPI_Request_Status_t SPI2_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData)
+{
+	return SPI_Executor_QueueRequest(SPI_Task_GetExecutor(SPI2), requestFunction, pData, SPI_PRIO_BULK);
+}
+
+SPI_Request_Status_t SPI_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData)
+{
+	return SPI_Executor_QueueRequest_fromISR(SPI_Task_GetExecutor(SPI1), requestFunction, pData, SPI_PRIO_BULK);
 }
 
-void SPI_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData)
+SPI_Request_Status_t SPI2_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData)
 {
-	SPI_Queue_Data_t spi_request;
+	return SPI_Executor_QueueRequest_fromISR(SPI_Task_GetExecutor(SPI2), requestFunction, pData, SPI_PRIO_BULK);
+}
 
-	if (requestFunction == NULL) return;
+// Returns true if an identical idempotent request is already part of the batch
+static bool SPI_Task_IsCoalesced(const SPI_Queue_Data_t* batch, uint8_t count, const SPI_Queue_Data_t* request)
+{
+	if (!(request->Flags & SPI_REQUEST_FLAG_IDEMPOTENT)) return false;
+
+	for (uint8_t i = 0; i < count; i++) {
+		if ((batch[i].Flags & SPI_REQUEST_FLAG_IDEMPOTENT) &&
+				batch[i].SPI_Request_Fp == request->SPI_Request_Fp &&
+				batch[i].Completion == request->Completion &&
+				batch[i].Handle == request->Handle &&
+				batch[i].ArgSize == request->ArgSize &&
+				memcmp(batch[i].Args.Bytes, request->Args.Bytes, request->ArgSize) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
 
-	spi_request.Handle = pData;
-	spi_request.SPI_Request_Fp = requestFunction;
-	SPI_Task_Send_Request_fromISR(spi_request);
+// Returns true if an identical idempotent request started after this one was queued, so its
+// execution already saw everything this one would. EnqueueCycles of started holds the start.
+static bool SPI_Task_IsCovered(const SPI_Queue_Data_t* started, uint8_t count, const SPI_Queue_Data_t* request)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		if ((int32_t) (started[i].EnqueueCycles - request->EnqueueCycles) > 0 &&
+				SPI_Task_IsCoalesced(&started[i], 1, request)) {
+			return true;
+		}
+	}
+	return false;
 }
 
-void SPI2_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData)
+static void SPI_Task_Execute(SPI_Executor_t* executor, SPI_Queue_Data_t* queue_data)
 {
-	SPI_Queue_Data_t spi_request;
+	// Inline arguments are passed from the task's own copy of the request
+	void* handle = (queue_data->ArgSize != 0) ? (void*) queue_data->Args.Bytes : queue_data->Handle;
+	uint32_t start_cycles = SPI_GetCycles();
+	const void* function = (queue_data->SPI_Request_Fp != NULL) ?
+			(const void*) queue_data->SPI_Request_Fp : (const void*) queue_data->Completion->Steps[0];
+
+	if (queue_data->SPI_Request_Fp != NULL) {
+		queue_data->SPI_Request_Fp(handle);
+	}
 
-	if (requestFunction == NULL) return;
+	// Continuations run back-to-back without being queued again
+	if (queue_data->Completion != NULL) {
+		SPI_Completion_Run(queue_data->Completion, handle);
+	}
 
-	spi_request.Handle = pData;
-	spi_request.SPI_Request_Fp = requestFunction;
-	SPI2_Task_Send_Request_fromISR(spi_request);
+	SPI_Stats_Record(&executor->Stats, function,
+			start_cycles - queue_data->EnqueueCycles, SPI_GetCycles() - start_cycles);
 }
 
-void SPI_Task (void* pvParameters){
-	UNUSED(pvParameters);
+// Moves requests from the ISR ring into the urgent batch or the bulk lane, returns the new batch size
+static uint8_t SPI_Task_DrainIsrRing(SPI_Executor_t* executor, SPI_Queue_Data_t* batch, uint8_t count)
+{
+	SPI_Isr_Ring_t* ring = &executor->IsrRing;
+	uint32_t tail = ring->Tail;
+	uint32_t head = __atomic_load_n(&ring->Head, __ATOMIC_ACQUIRE);
+
+	while (tail != head && count < SPI_TASK_BATCH_SIZE) {
+		SPI_Isr_Request_t request = ring->Entries[tail & (SPI_ISR_RING_SIZE - 1)];
+
+		// Hand the slot back to the producer
+		tail++;
+		__atomic_store_n(&ring->Tail, tail, __ATOMIC_RELEASE);
+
+		if (request.Priority == SPI_PRIO_URGENT) {
+			if (!SPI_Task_IsCoalesced(batch, count, &request.Data)) {
+				batch[count++] = request.Data;
+			}
+			else {
+				executor->Stats.Coalesced++;
+			}
+		}
+		else if (xQueueSendToBack(executor->Lanes[SPI_PRIO_BULK], &request.Data, 0) != pdPASS) {
+			SPI_Executor_CountDrop(executor, SPI_PRIO_BULK);
+		}
+	}
+
+	return count;
+}
+
+// Executes all pending requests. The urgent lane is emptied batch-wise, between two bulk
+// requests the urgent lane is checked again.
+static void SPI_Task_DrainLanes(SPI_Executor_t* executor)
+{
+	SPI_Queue_Data_t batch[SPI_TASK_BATCH_SIZE];
 	SPI_Queue_Data_t queue_data = {0};
+	// Idempotent bulk requests started during this drain. Every request pending at their start
+	// is received before the drain returns, so older ones aren't needed.
+	SPI_Queue_Data_t bulk_started[SPI_TASK_BULK_WINDOW];
+	uint8_t bulk_count = 0, bulk_next = 0;
+	uint8_t count;
 
 	for( ;; )
 	{
-		// Block on event queue
-		if (xQueueReceive(SPI_QueueHandle, &queue_data, portMAX_DELAY))
-		{
-			queue_data.SPI_Request_Fp(queue_data.Handle);
+		// Collect pending urgent requests (ISR ring first), drop idempotent duplicates
+		count = SPI_Task_DrainIsrRing(executor, batch, 0);
+		while (count < SPI_TASK_BATCH_SIZE &&
+				xQueueReceive(executor->Lanes[SPI_PRIO_URGENT], &queue_data, 0) == pdPASS) {
+			if (!SPI_Task_IsCoalesced(batch, count, &queue_data)) {
+				batch[count++] = queue_data;
+			}
+			else {
+				executor->Stats.Coalesced++;
+			}
+		}
+
+		for (uint8_t i = 0; i < count; i++) {
+			SPI_Task_Execute(executor, &batch[i]);
 		}
+
+		if (count != 0) continue;
+
+		// Urgent lane empty, execute one bulk request
+		if (xQueueReceive(executor->Lanes[SPI_PRIO_BULK], &queue_data, 0) != pdPASS) {
+			return; // Both lanes empty
+		}
+		if (SPI_Task_IsCovered(bulk_started, bulk_count, &queue_data)) {
+			executor->Stats.Coalesced++;
+			continue;
+		}
+		if (queue_data.Flags & SPI_REQUEST_FLAG_IDEMPOTENT) {
+			bulk_started[bulk_next] = queue_data;
+			bulk_started[bulk_next].EnqueueCycles = SPI_GetCycles();
+			bulk_next = (bulk_next + 1) % SPI_TASK_BULK_WINDOW;
+			if (bulk_count < SPI_TASK_BULK_WINDOW) bulk_count++;
+		}
+		SPI_Task_Execute(executor, &queue_data);
 	}
-	vTaskDelete( NULL);
 }
 
-void SPI2_Task (void* pvParameters){
-	UNUSED(pvParameters);
-	SPI_Queue_Data_t queue_data = {0};
+void SPI_Task (void* pvParameters){
+	SPI_Executor_t* executor = (SPI_Executor_t*) pvParameters;
+	uint8_t spi_idx = get_spi_index(executor->Config->Instance);
 
 	for( ;; )
 	{
-		// Block on event queue
-		if (xQueueReceive(SPI2_QueueHandle, &queue_data, portMAX_DELAY))
+		// A hung asynchronous transfer expires here even if no other task waits for the bus
+		TickType_t wait = SPI_Bus_ExpireAsync(spi_idx);
+		if (wait > pdMS_TO_TICKS(SPI_TASK_EXPIRY_MS)) wait = pdMS_TO_TICKS(SPI_TASK_EXPIRY_MS);
+
+		// Block until at least one request is queued or the deadline is due, then drain everything pending
+		if (ulTaskNotifyTake(pdTRUE, wait))
 		{
-			queue_data.SPI_Request_Fp(queue_data.Handle);
+			SPI_Task_DrainLanes(executor);
 		}
+		SPI_Bus_RunLateCompletions(spi_idx);
 	}
 	vTaskDelete( NULL);
 }
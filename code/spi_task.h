@@ -12,35 +12,228 @@
 #include "queue.h"
 #include "task.h"
 
+#include "spi_devices.h"
+#include "stdbool.h"
+
+// Default executor settings, can be tuned per bus in spi_executor_configs[]
 #define SPI_TASK_STACK_SIZE   512 //configMINIMAL_STACK_SIZE
 #define SPI_QUEUE_SIZE        60//50//30//16//8
+#define SPI_URGENT_QUEUE_SIZE 8
+#define SPI_TASK_PRIORITY     tskIDLE_PRIORITY
+#define SPI_TASK_BATCH_SIZE   8   // Urgent requests collected per batch
+#define SPI_TASK_BULK_WINDOW  4   // Started idempotent bulk requests remembered for coalescing
+#define SPI_QUEUE_TIMEOUT     (( TickType_t )100) // Default wait for SPI_BP_BLOCK
+#define SPI_TASK_EXPIRY_MS    10  // Longest sleep of the SPI Task before it checks the asynchronous deadline again
+#define SPI_COMPLETION_MAX_STEPS 4 // Steps (request + continuations) per completion
+#define SPI_REQUEST_ARG_SIZE  16  // Bytes of inline arguments per request
+#define SPI_ISR_RING_SIZE     16  // Requests from ISR context per bus, power of two
+
+#if (SPI_ISR_RING_SIZE & (SPI_ISR_RING_SIZE - 1)) != 0
+#error "SPI_ISR_RING_SIZE must be a power of two"
+#endif
+
+// Statistics
+#define SPI_STATS_HIST_BUCKETS   16 // Latency histogram buckets, bucket n: [2^(n+SHIFT), 2^(n+SHIFT+1)) cycles
+#define SPI_STATS_HIST_SHIFT     8  // Bucket 0 holds everything below 2^(SHIFT+1) cycles
+#define SPI_STATS_MAX_FUNCTIONS  16 // Distinct request functions counted per bus
+
+// Request Flags
+#define SPI_REQUEST_FLAG_NONE        0x00
+#define SPI_REQUEST_FLAG_IDEMPOTENT  0x01 // Pending duplicates (same function, handle and arguments) are executed once
+
+// Request Priority
+// Every bus owns one queue per lane. The SPI Task always empties the urgent lane
+// before it takes the next request from the bulk lane.
+typedef enum SPI_Request_Priority
+{
+  SPI_PRIO_URGENT = 0, // Interrupt servicing, control-loop I/O
+  SPI_PRIO_BULK,       // Socket management, bulk transfers
+  SPI_PRIO_COUNT
+} SPI_Request_Priority_t;
+
+// Backpressure
+// Chosen by the caller, decides what happens if the lane is full
+typedef enum SPI_Backpressure
+{
+  SPI_BP_BLOCK = 0,   // Wait up to the given timeout for free space
+  SPI_BP_DROP_OLDEST, // Shed the oldest request of the lane to make room
+  SPI_BP_FAIL_FAST    // Return immediately (always used in ISR context)
+} SPI_Backpressure_t;
+
+typedef enum SPI_Request_Status
+{
+  SPI_REQUEST_OK = 0,
+  SPI_REQUEST_DROPPED_OLDEST, // Queued, an older request of the lane was shed
+  SPI_REQUEST_QUEUE_FULL,     // Not queued
+  SPI_REQUEST_INVALID         // No executor, no request function or completion still pending
+} SPI_Request_Status_t;
 
 // Queue Data
 typedef void (*Fp_SPI_Queue_Request)(void * Handle);//Function Pointer used in SPI Task Queue as Request Message
 //typedef void (*Fp_SPI_Queue_Callback)(void* Handle);//Function Pointer used in SPI Task Queue as Callback Message
 
+// Completion
+// Caller-owned record of a queued step sequence. The steps run back-to-back in the SPI Task,
+// a negative step result stops the sequence. The on-complete callback runs in SPI Task
+// context afterwards (or in the shedding task's context, see SPI_BP_DROP_OLDEST).
+typedef int32_t (*Fp_SPI_Queue_Step)(void* Handle); // < 0: failed, abort remaining steps
+
+typedef struct SPI_Completion SPI_Completion_t;
+typedef void (*Fp_SPI_Completion_Callback)(SPI_Completion_t* completion, void* Context);
+
+#define SPI_COMPLETION_ERR_DROPPED  (-1000) // Result if the request was shed before execution
+
+typedef enum SPI_Completion_State
+{
+  SPI_COMPLETION_IDLE = 0,
+  SPI_COMPLETION_PENDING, // Queued or executing
+  SPI_COMPLETION_DONE,    // All steps succeeded
+  SPI_COMPLETION_FAILED   // A step failed or the request was shed, see Result
+} SPI_Completion_State_t;
+
+struct SPI_Completion
+{
+  volatile SPI_Completion_State_t State;
+  int32_t                         Result;     // Result of the last executed step
+  uint8_t                         StepsRun;   // Executed steps, including a failed one
+  uint8_t                         StepCount;
+  Fp_SPI_Queue_Step               Steps[SPI_COMPLETION_MAX_STEPS];
+  Fp_SPI_Completion_Callback      OnComplete; // Optional
+  void*                           Context;
+};
+
+// Requests are copied by value into the queue. Arguments up to SPI_REQUEST_ARG_SIZE bytes can
+// be stored inline: if ArgSize != 0 the request function and all steps receive a pointer to
+// the task's copy of Args instead of Handle, valid until the request has finished.
 typedef struct SPI_Queue_Data
 {
   Fp_SPI_Queue_Request SPI_Request_Fp;
 //  Fp_SPI_Queue_Callback SPI_Callback_Fp;
   void* Handle;
-//  uint32_t data;
+  uint8_t Flags; // SPI_REQUEST_FLAG_*
+  uint8_t ArgSize;
+  uint32_t EnqueueCycles; // Set when queued, see SPI_GetCycles()
+  SPI_Completion_t* Completion; // Steps executed after SPI_Request_Fp, may be NULL
+  union {
+    uint8_t  Bytes[SPI_REQUEST_ARG_SIZE];
+    uint32_t Align;
+  } Args;
 } SPI_Queue_Data_t;
 
+// Executor
+// One executor (task + lanes) exists per configured SPI bus
+typedef struct SPI_Executor_Config
+{
+  SPI_TypeDef*           Instance;
+  const char*            TaskName;
+  const char*            QueueNames[SPI_PRIO_COUNT];
+  configSTACK_DEPTH_TYPE StackSize;
+  UBaseType_t            QueueSize[SPI_PRIO_COUNT];
+  UBaseType_t            Priority;
+  const char*            ErrorText; // Shown if the executor can't be created
+} SPI_Executor_Config_t;
+
+typedef struct SPI_Executor_Function_Stats
+{
+  const void* Function;   // Request function or first step of a completion
+  uint32_t    Executions;
+} SPI_Executor_Function_Stats_t;
+
+typedef struct SPI_Executor_Stats
+{
+  uint32_t HighWater[SPI_PRIO_COUNT];          // Maximum queued requests per lane
+  uint32_t IsrRingHighWater;                   // Maximum requests pending in the ISR ring
+  uint32_t Coalesced;                          // Idempotent duplicates not executed
+  uint32_t WaitHistogram[SPI_STATS_HIST_BUCKETS]; // Enqueue -> start [cycles]
+  uint32_t RunHistogram[SPI_STATS_HIST_BUCKETS];  // Start -> finish [cycles]
+  uint32_t MaxWaitCycles;
+  uint32_t MaxRunCycles;
+  SPI_Executor_Function_Stats_t Functions[SPI_STATS_MAX_FUNCTIONS];
+  uint32_t OtherExecutions;                    // Executions not fitting into Functions
+} SPI_Executor_Stats_t;
+
+// Ring for requests from ISR context. Producers write Head inside an ISR critical section, so
+// interrupts of different NVIC priorities may queue into one bus. Tail is only written by the
+// SPI Task, which reads without masking interrupts.
+typedef struct SPI_Isr_Request
+{
+  SPI_Queue_Data_t       Data;
+  SPI_Request_Priority_t Priority;
+} SPI_Isr_Request_t;
+
+typedef struct SPI_Isr_Ring
+{
+  SPI_Isr_Request_t Entries[SPI_ISR_RING_SIZE];
+  volatile uint32_t Head;
+  volatile uint32_t Tail;
+} SPI_Isr_Ring_t;
+
+typedef struct SPI_Executor
+{
+  const SPI_Executor_Config_t* Config;
+  QueueHandle_t                Lanes[SPI_PRIO_COUNT];
+  TaskHandle_t                 TaskHandle;
+  volatile uint32_t            Dropped[SPI_PRIO_COUNT]; // Requests shed or rejected per lane
+  SPI_Executor_Stats_t         Stats;
+  SPI_Isr_Ring_t               IsrRing;
+} SPI_Executor_t;
+
 
 
 // Functions
 void SPI_Task_Init(void);
 
-void SPI_Task_Send_Request(SPI_Queue_Data_t queue_data);
-void SPI_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData);
-void SPI_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data);
-void SPI_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData);
+// Returns NULL if no executor is configured for the bus
+SPI_Executor_t* SPI_Task_GetExecutor(SPI_TypeDef* instance);
+SPI_Executor_t* SPI_Task_GetExecutorByIndex(uint8_t spi_idx);
+
+SPI_Request_Status_t SPI_Executor_Send_Request(SPI_Executor_t* executor, SPI_Queue_Data_t queue_data, SPI_Request_Priority_t priority,
+    SPI_Backpressure_t backpressure, TickType_t timeout);
+// Queues into the ISR ring of the bus, fails fast if the ring is full
+SPI_Request_Status_t SPI_Executor_Send_Request_fromISR(SPI_Executor_t* executor, SPI_Queue_Data_t queue_data, SPI_Request_Priority_t priority);
+
+// Shortcuts using SPI_BP_BLOCK with SPI_QUEUE_TIMEOUT (task) or the ISR ring
+SPI_Request_Status_t SPI_Executor_QueueRequest(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction, void *pData, SPI_Request_Priority_t priority);
+SPI_Request_Status_t SPI_Executor_QueueRequest_fromISR(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction, void *pData, SPI_Request_Priority_t priority);
+
+// Inline arguments, false if they don't fit into SPI_REQUEST_ARG_SIZE
+bool SPI_Queue_Data_SetArgs(SPI_Queue_Data_t* queue_data, const void* args, uint8_t size);
+SPI_Request_Status_t SPI_Executor_QueueRequestArgs(SPI_Executor_t* executor, Fp_SPI_Queue_Request requestFunction,
+    const void* args, uint8_t size, SPI_Request_Priority_t priority);
+
+// Completion handles
+// Init and Then fail (return false / NULL) while the completion is pending.
+bool SPI_Completion_Init(SPI_Completion_t* completion, Fp_SPI_Completion_Callback onComplete, void* context);
+bool SPI_Completion_Then(SPI_Completion_t* completion, Fp_SPI_Queue_Step step);
+static inline bool SPI_Completion_IsPending(const SPI_Completion_t* completion) {
+  return completion->State == SPI_COMPLETION_PENDING;
+}
+
+// Queues the steps of the completion as one request with inline arguments (may be NULL / 0),
+// returns the completion or NULL if not queued
+SPI_Completion_t* SPI_Executor_QueueSteps(SPI_Executor_t* executor, SPI_Completion_t* completion,
+    const void* args, uint8_t size, SPI_Request_Priority_t priority, SPI_Backpressure_t backpressure, TickType_t timeout);
+
+uint32_t SPI_Executor_GetDropCount(SPI_Executor_t* executor, SPI_Request_Priority_t priority);
+
+// Statistics, copied consistently
+bool SPI_Executor_GetStats(SPI_Executor_t* executor, SPI_Executor_Stats_t* stats);
+void SPI_Executor_ResetStats(SPI_Executor_t* executor);
+// Lower bound of a histogram bucket in cycles
+static inline uint32_t SPI_Stats_BucketCycles(uint8_t bucket) {
+  return (bucket == 0) ? 0 : (1UL << (bucket + SPI_STATS_HIST_SHIFT));
+}
+
+// Bus specific shortcuts, requests are queued in the bulk lane
+SPI_Request_Status_t SPI_Task_Send_Request(SPI_Queue_Data_t queue_data);
+SPI_Request_Status_t SPI_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData);
+SPI_Request_Status_t SPI_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data);
+SPI_Request_Status_t SPI_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData);
 
-void SPI2_Task_Send_Request(SPI_Queue_Data_t queue_data);
-void SPI2_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData);
-void SPI2_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data);
-void SPI2_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData);
+SPI_Request_Status_t SPI2_Task_Send_Request(SPI_Queue_Data_t queue_data);
+SPI_Request_Status_t SPI2_QueueRequest(Fp_SPI_Queue_Request requestFunction, void *pData);
+SPI_Request_Status_t SPI2_Task_Send_Request_fromISR(SPI_Queue_Data_t queue_data);
+SPI_Request_Status_t SPI2_QueueRequest_fromISR(Fp_SPI_Queue_Request requestFunction, void *pData);
 
 
 
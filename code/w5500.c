@@ -59,6 +59,10 @@
 #define _W5500_SPI_FDM_OP_LEN2_     0x02
 #define _W5500_SPI_FDM_OP_LEN4_     0x03
 
+#ifndef _WIZCHIP_SPI_RETRIES_
+#define _WIZCHIP_SPI_RETRIES_       2   // Retries of a failed socket buffer access
+#endif
+
 #if   (_WIZCHIP_ == 5500)
 ////////////////////////////////////////////////////
 wiz_NetInfo default_netInfo = {
@@ -125,6 +129,25 @@ void     WIZCHIP_WRITE(uint32_t AddrSel, uint8_t wb) {
   WIZCHIP_CRITICAL_EXIT();
 }
 
+/**
+ * Socket buffer access through the bus guard with _WIZCHIP_SPI_RETRIES_ retries.
+ * Only buffer accesses are repeated: they read or fill socket memory and the pointer
+ * registers are moved separately. The device default is no retries, a repeated Sn_CR
+ * write would run the socket command twice.
+ */
+static void wizchip_buf_transfer(const spi_segment_t* segments, uint8_t count) {
+  bus_device_t* bus_device = (bus_device_t*) WIZCHIP.gen_device_h;
+  spi_bus_guard_t guard;
+
+  SPI_Device_Acquire(&guard, (void*) &bus_device->spi_device_handle);
+  guard.target.retries = _WIZCHIP_SPI_RETRIES_;
+  SPI_Guard_Transfer(&guard, segments, count);
+
+  if (SPI_Bus_Release(&guard) != HAL_OK) {
+    bus_device->error = true;
+  }
+}
+
 void     WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len) {
   uint8_t spi_data[3];
   uint16_t i;
@@ -145,37 +168,88 @@ void     WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len) {
     spi_data[1] = (AddrSel & 0x0000FF00) >> 8;
     spi_data[2] = (AddrSel & 0x000000FF) >> 0;
 
-    WIZCHIP.IF.SPI._write_then_read(spi_data, 3, pBuf, len);
+    if (WIZCHIP.gen_device_h != NULL) {
+      // Header + data segments, _write_then_read takes 8 bit lengths and doesn't retry
+      spi_segment_t segments[2] = {
+        { .tx = spi_data, .len = 3, .keep_cs = true },
+        { .rx = pBuf, .len = len },
+      };
+
+      wizchip_buf_transfer(segments, 2);
+    } else {
+      WIZCHIP.IF.SPI._write_then_read(spi_data, 3, pBuf, len);
+    }
   }
 
   WIZCHIP_CRITICAL_EXIT();
 }
 
 void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len) {
-  uint8_t spi_data[3 + len];
+  uint8_t spi_data[3];
+  uint16_t i;
 
   WIZCHIP_CRITICAL_ENTER();
 
   AddrSel |= (_W5500_SPI_WRITE_ | _W5500_SPI_VDM_OP_);
 
-  // Build the header
   spi_data[0] = (AddrSel & 0x00FF0000) >> 16;
   spi_data[1] = (AddrSel & 0x0000FF00) >> 8;
   spi_data[2] = (AddrSel & 0x000000FF) >> 0;
 
-  // Append pBuf to spi_data
-  memcpy(&spi_data[3], pBuf, len);
-
-  if (!WIZCHIP.IF.SPI._write_burst) {
-    for (uint16_t i = 0; i < 3 + len; i++)          // byte operation
+  if (!WIZCHIP.IF.SPI._write_burst || WIZCHIP.gen_device_h == NULL) {	// byte operation
+    for (i = 0; i < 3; i++)
       WIZCHIP.IF.SPI._write_byte(spi_data[i]);
-  } else {
-    WIZCHIP.IF.SPI._write_burst(spi_data, 3 + len); // burst operation
+    for (i = 0; i < len; i++)
+      WIZCHIP.IF.SPI._write_byte(pBuf[i]);
+  } else {															// burst operation
+    // Header and payload in one CS frame, the payload goes out from pBuf without a copy
+    spi_segment_t segments[2] = {
+      { .tx = spi_data, .len = 3, .keep_cs = true },
+      { .tx = pBuf, .len = len },
+    };
+
+    wizchip_buf_transfer(segments, (len > 0) ? 2 : 1);
   }
 
   WIZCHIP_CRITICAL_EXIT();
 }
 
+void     WIZCHIP_ACCESS_LIST(const wiz_Access* list, uint8_t count) {
+  uint8_t headers[WIZCHIP_ACCESS_LIST_MAX][3];
+  spi_segment_t segments[2 * WIZCHIP_ACCESS_LIST_MAX] = {0};
+  uint32_t AddrSel;
+  uint8_t i;
+
+  if (WIZCHIP.gen_device_h == NULL || count > WIZCHIP_ACCESS_LIST_MAX) {
+    for (i = 0; i < count; i++) {
+      if (list[i].write) WIZCHIP_WRITE_BUF(list[i].AddrSel, list[i].pBuf, list[i].len);
+      else               WIZCHIP_READ_BUF(list[i].AddrSel, list[i].pBuf, list[i].len);
+    }
+    return;
+  }
+
+  WIZCHIP_CRITICAL_ENTER();
+
+  // Header and data of one access share a CS frame, the frame ends after the data
+  for (i = 0; i < count; i++) {
+    AddrSel = list[i].AddrSel | (list[i].write ? _W5500_SPI_WRITE_ : _W5500_SPI_READ_) | _W5500_SPI_VDM_OP_;
+    headers[i][0] = (AddrSel & 0x00FF0000) >> 16;
+    headers[i][1] = (AddrSel & 0x0000FF00) >> 8;
+    headers[i][2] = (AddrSel & 0x000000FF) >> 0;
+
+    segments[2 * i].tx = headers[i];
+    segments[2 * i].len = 3;
+    segments[2 * i].keep_cs = true;
+
+    if (list[i].write) segments[2 * i + 1].tx = list[i].pBuf;
+    else               segments[2 * i + 1].rx = list[i].pBuf;
+    segments[2 * i + 1].len = list[i].len;
+  }
+
+  wizchip_buf_transfer(segments, 2 * count);
+
+  WIZCHIP_CRITICAL_EXIT();
+}
 
 uint16_t getSn_TX_FSR(uint8_t sn) {
   uint16_t val = 0, val1 = 0;
@@ -209,6 +283,7 @@ uint16_t getSn_RX_RSR(uint8_t sn) {
 void wiz_send_data(uint8_t sn, uint8_t *wizdata, uint16_t len) {
   uint16_t ptr = 0;
   uint32_t addrsel = 0;
+  uint8_t ptr_data[2];
 
   if (len == 0) {
     return;
@@ -218,15 +293,22 @@ void wiz_send_data(uint8_t sn, uint8_t *wizdata, uint16_t len) {
   //addrsel = (ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3);
   addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3);
   //
-  WIZCHIP_WRITE_BUF(addrsel, wizdata, len);
-
   ptr += len;
-  setSn_TX_WR(sn, ptr);
+  ptr_data[0] = (uint8_t)(ptr >> 8);
+  ptr_data[1] = (uint8_t) ptr;
+
+  // Payload and the new write pointer under one bus lock, both are safe to repeat
+  wiz_Access list[2] = {
+    { .AddrSel = addrsel, .pBuf = wizdata, .len = len, .write = 1 },
+    { .AddrSel = Sn_TX_WR(sn), .pBuf = ptr_data, .len = 2, .write = 1 },
+  };
+  WIZCHIP_ACCESS_LIST(list, 2);
 }
 
 void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len) {
   uint16_t ptr = 0;
   uint32_t addrsel = 0;
+  uint8_t ptr_data[2];
 
   if (len == 0) {
     return;
@@ -236,10 +318,16 @@ void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len) {
   //addrsel = ((ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
   addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
   //
-  WIZCHIP_READ_BUF(addrsel, wizdata, len);
   ptr += len;
-
-  setSn_RX_RD(sn, ptr);
+  ptr_data[0] = (uint8_t)(ptr >> 8);
+  ptr_data[1] = (uint8_t) ptr;
+
+  // Payload and the new read pointer under one bus lock, both are safe to repeat
+  wiz_Access list[2] = {
+    { .AddrSel = addrsel, .pBuf = wizdata, .len = len, .write = 0 },
+    { .AddrSel = Sn_RX_RD(sn), .pBuf = ptr_data, .len = 2, .write = 1 },
+  };
+  WIZCHIP_ACCESS_LIST(list, 2);
 }
 
 
@@ -335,6 +423,7 @@ void W5500_Ethernet_Init(bus_device_t* device_h) {
   // Load custom values
   device_h->spi_device_handle.spi_h->Init.NSSPMode = SPI_NSS_PULSE_DISABLE;
   device_h->spi_device_handle.spi_h->Init.Direction = SPI_DIRECTION_2LINES;
+  SPI_Bus_InvalidateConfig(device_h->spi_device_handle.spi_instance);
   device_h->spi_device_handle.spi_settings.BaudRate = default_spiSettings.BaudRate;
   device_h->spi_device_handle.spi_settings.CLKPhase = default_spiSettings.CLKPhase;
   device_h->spi_device_handle.spi_settings.CLKPolarity = default_spiSettings.CLKPolarity;
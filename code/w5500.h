@@ -1247,6 +1247,33 @@ void     WIZCHIP_READ_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
 */
 void     WIZCHIP_WRITE_BUF(uint32_t AddrSel, uint8_t* pBuf, uint16_t len);
 
+#define WIZCHIP_ACCESS_LIST_MAX   8   ///< Register accesses per @ref WIZCHIP_ACCESS_LIST() call
+
+/**
+    @ingroup Basic_IO_function
+    @brief One register access of an access list, see @ref WIZCHIP_ACCESS_LIST().
+*/
+typedef struct wiz_Access_t
+{
+    uint32_t AddrSel;   ///< Register address
+    uint8_t* pBuf;      ///< Data to write or buffer to read into
+    uint16_t len;       ///< Data length
+    uint8_t  write;     ///< 1: write pBuf to the registers, 0: read the registers into pBuf
+} wiz_Access;
+
+/**
+    @ingroup Basic_IO_function
+    @brief It executes several register accesses as one SPI transaction list.
+    @details Every access is still its own CS-framed W5500 frame, but the whole list
+    holds the bus lock once instead of once per access.
+    A failed list is repeated as a whole like a buffer access, so it may only hold
+    accesses that are safe to repeat: buffers and pointer registers, no Sn_CR.
+    Lists longer than @ref WIZCHIP_ACCESS_LIST_MAX fall back to single accesses.
+    @param list Register accesses, executed in order
+    @param count Number of accesses
+*/
+void     WIZCHIP_ACCESS_LIST(const wiz_Access* list, uint8_t count);
+
 /////////////////////////////////
 // Common Register I/O function //
 /////////////////////////////////